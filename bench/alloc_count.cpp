@@ -0,0 +1,35 @@
+#include "alloc_count.h"
+#include <atomic>
+#include <stddef.h>
+
+/**
+ * Counts every malloc, calloc and realloc by wrapping the glibc allocator,
+ * operator new goes through malloc so it is counted as well.
+ */
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+
+static std::atomic<uint64_t> g_alloc_count(0);
+
+uint64_t alloc_count(void) { return g_alloc_count.load(); }
+
+extern "C" void *malloc(size_t size) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr) { __libc_free(ptr); }
@@ -0,0 +1,9 @@
+#ifndef __ALLOC_COUNT_H__
+#define __ALLOC_COUNT_H__
+
+#include <stdint.h>
+
+// Heap allocations made by the process so far, host build only
+uint64_t alloc_count(void);
+
+#endif
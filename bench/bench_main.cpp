@@ -0,0 +1,1162 @@
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <unistd.h>
+
+#include "alloc_count.h"
+#include "color_kernels.h"
+#include "compositor.h"
+#include "effects.h"
+#include "fd_stream.h"
+#include "frame_recording.h"
+#include "led_controller.h"
+#include "network_input.h"
+#include "palette.h"
+#include "palettes.h"
+#include "serial_input.h"
+
+/******************************************************************************
+ * Benchmark harness
+ ******************************************************************************/
+static const uint16_t STRIP_LENGTHS[] = {60, 250, 1000, 4000, 10000};
+
+// Minimum time spent on each measurement
+static uint32_t g_min_time_ms = 200;
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Run op until the minimum time elapsed and return the average ns per call.
+ */
+template <typename Op> static double measure(Op op) {
+    // Warm up caches and lazy state
+    for (int i = 0; i < 4; i++) {
+        op();
+    }
+    uint64_t iterations = 0;
+    Clock::time_point start = Clock::now();
+    Clock::duration min_time = std::chrono::milliseconds(g_min_time_ms);
+    Clock::duration elapsed;
+    do {
+        for (int i = 0; i < 16; i++) {
+            op();
+        }
+        iterations += 16;
+        elapsed = Clock::now() - start;
+    } while (elapsed < min_time);
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+               .count() /
+           iterations;
+}
+
+// Checks that failed, the exit status of the bench
+static uint32_t g_failures = 0;
+
+// Checks report their numbers like benchmarks, a failed one is also counted
+// and named so a run with a wrong result exits nonzero
+static void expect(bool ok, const char *name, uint16_t leds) {
+    if (!ok) {
+        printf("%-28s %6u %12s\n", name, leds, "FAILED");
+        g_failures++;
+    }
+}
+
+static void report(const char *name, uint16_t leds, double ns_per_frame) {
+    printf("%-28s %6u %12.2f %12.1f\n", name, leds, ns_per_frame / leds,
+           1e9 / ns_per_frame);
+}
+
+// Change one pixel so the next publish() produces a new frame
+static void touch(ILedStrip &strip) {
+    static uint32_t frame = 0;
+    frame++;
+    strip.updatePixel(0, Color(frame & 0xff, 0, 0));
+    strip.publish();
+}
+
+/******************************************************************************
+ * Benchmarks
+ ******************************************************************************/
+static void bench_palette(uint16_t leds) {
+    Palette palette = RainbowPalette(255);
+    ArrayList<Color> colors(leds);
+    double ns = measure([&]() {
+        for (uint16_t i = 0; i < leds; i++) {
+            palette.interp(i & 0xff, colors[i]);
+        }
+    });
+    report("Palette::interp", leds, ns);
+    ns = measure([&]() {
+        for (uint16_t i = 0; i < leds; i++) {
+            palette.lookup(i & 0xff, colors[i]);
+        }
+    });
+    report("Palette::lookup", leds, ns);
+    Palette flash_palette(palettes::RAINBOW);
+    ns = measure([&]() {
+        for (uint16_t i = 0; i < leds; i++) {
+            flash_palette.lookup(i & 0xff, colors[i]);
+        }
+    });
+    report("Palette::lookup (flash)", leds, ns);
+}
+
+static void bench_kernels(uint16_t leds) {
+    Palette palette(255, Color::WHITE, Color(0xff, 0xb0, 0xf0));
+    LedsList colors(leds);
+    for (uint16_t i = 0; i < leds; i++) {
+        colors[i] = Color(i * 7, i * 3, i);
+    }
+    report("Palette::correct_colors", leds,
+           measure([&]() { palette.correct_colors(colors); }));
+    report("color_scale", leds, measure([&]() { color_scale(colors, 250); }));
+    report("color_fade", leds,
+           measure([&]() { color_fade(colors, Color::ORANGE, 16); }));
+    report("color_add", leds,
+           measure([&]() { color_add(colors, colors); }));
+}
+
+template <typename T>
+static void bench_heat(const char *name, uint16_t leds) {
+    LedStrip strip(leds, 0, NEO_RBG + NEO_KHZ800);
+    HeatBase<T> effect(&strip, RainbowPalette(255));
+    effect.setMinHeat(0);
+    effect.setMaxHeat(255);
+    report(name, leds, measure([&]() { effect.update(EFFECT_TICK_US); }));
+}
+
+static void bench_sparks(uint16_t leds) {
+    LedStrip strip(leds, 0, NEO_RBG + NEO_KHZ800);
+    Sparks<uint8_t> effect(&strip, Palette(255, Color::WHITE, Color::WHITE));
+    effect.setMinHeat(20);
+    effect.setMaxHeat(255);
+    effect.setColdDown(-2.5f);
+    effect.setNumOfSparks(0.75f);
+    effect.setSparkValue(255);
+    report("Sparks::update", leds,
+           measure([&]() { effect.update(EFFECT_TICK_US); }));
+}
+
+// Decoding a recording of Sparks, compare with rendering it above
+static void bench_playback(uint16_t leds) {
+    FILE *file = tmpfile();
+    FrameRecorder *recorder =
+        new FrameRecorder(new FileFrameSink(file), leds, 60, 60);
+    Sparks<uint8_t> effect(recorder, Palette(255, Color::WHITE, Color::WHITE));
+    effect.setMinHeat(20);
+    effect.setMaxHeat(255);
+    effect.setColdDown(-2.5f);
+    effect.setNumOfSparks(0.75f);
+    effect.setSparkValue(255);
+    for (int i = 0; i < 240; i++) {
+        effect.update(EFFECT_TICK_US);
+        recorder->recordFrame();
+    }
+    ArrayList<uint8_t> data(recorder->getEncoder().getSize());
+    fflush(file);
+    rewind(file);
+    size_t size = fread(data.data(), 1, data.count(), file);
+    MemoryFrameSource source(data.data(), size);
+    FrameDecoder decoder(&source);
+    decoder.begin();
+    report("FrameDecoder::nextFrame", leds, measure([&]() {
+               if (!decoder.nextFrame()) {
+                   decoder.rewind();
+                   decoder.nextFrame();
+               }
+           }));
+    delete recorder;
+}
+
+// Parse a whole frame packet fed in chunks of the size poll() reads
+static void bench_serial(uint16_t leds) {
+    LedStrip strip(leds, 0, NEO_GRB + NEO_KHZ800);
+    SerialInput input(nullptr);
+    input.addStrip(&strip);
+    ArrayList<uint8_t> rgb(3 * leds);
+    for (size_t i = 0; i < rgb.count(); i++) {
+        rgb[i] = (uint8_t)(i * 7);
+    }
+    ArrayList<uint8_t> packet(SERIAL_HEADER_SIZE + 3 * leds +
+                              SERIAL_CHECKSUM_SIZE);
+    size_t size = BuildSerialFrame(packet.data(), packet.count(), 0,
+                                   rgb.data(), leds, true);
+    report("SerialInput::feed", leds, measure([&]() {
+               for (size_t i = 0; i < size; i += SERIAL_INPUT_CHUNK_SIZE) {
+                   size_t len = size - i < SERIAL_INPUT_CHUNK_SIZE
+                                    ? size - i
+                                    : SERIAL_INPUT_CHUNK_SIZE;
+                   input.feed(packet.data() + i, len);
+               }
+           }));
+}
+
+static void bench_random(uint16_t leds) {
+    LedsList values(leds);
+    uint32_t *indexes = (uint32_t *)values.data();
+    report("rand() % leds", leds, measure([&]() {
+               for (uint16_t i = 0; i < leds; i++) {
+                   indexes[i] = rand() % leds;
+               }
+           }));
+    Random random;
+    report("Random::indexes", leds,
+           measure([&]() { random.indexes(indexes, leds, leds); }));
+}
+
+static void bench_roll(uint16_t leds) {
+    LedStrip strip(leds, 0, NEO_RBG + NEO_KHZ800);
+    Roll<uint8_t> effect(&strip, RainbowPalette(8));
+    effect.setMinHeat(0);
+    effect.setMaxHeat(8);
+    effect.setSpeed(0.1f);
+    effect.setRollSpeed(1.0f);
+    report("Roll::update", leds,
+           measure([&]() { effect.update(EFFECT_TICK_US); }));
+}
+
+static void bench_pulses(uint16_t leds) {
+    LedStrip strip(leds, 0, NEO_RBG + NEO_KHZ800);
+    Pulses<uint8_t> effect(&strip, RainbowPalette(255));
+    effect.setMinHeat(0);
+    effect.setMaxHeat(255);
+    effect.setSpeed(1);
+    report("Pulses::update", leds,
+           measure([&]() { effect.update(EFFECT_TICK_US); }));
+}
+
+static void bench_strip(uint16_t leds) {
+    LedStrip strip(leds, 0, NEO_RBG + NEO_KHZ800);
+    LedsList colors(leds);
+    for (uint16_t i = 0; i < leds; i++) {
+        colors[i] = Color(i * 7, i * 3, i);
+    }
+    strip.begin();
+    report("LedStrip::updateSegment", leds, measure([&]() {
+               strip.updateSegment(colors, 0, leds);
+               strip.publish();
+           }));
+    report("LedStrip::draw", leds, measure([&]() {
+               touch(strip);
+               strip.draw();
+           }));
+    report("LedStrip::draw (unchanged)", leds,
+           measure([&]() { strip.draw(); }));
+
+    ILedStrip *segment = strip.GetSegment(PixelMap::matrix(
+        0, leds / 10, 10, MATRIX_ROWS | MATRIX_SERPENTINE));
+    LedsList matrix_colors(segment->getNumPixels());
+    report("LedStripSegment (matrix)", leds, measure([&]() {
+               segment->updatePixels(matrix_colors);
+               segment->publish();
+           }));
+    strip.ReleaseSegment(segment);
+
+    LedStrip rgbw(leds, 0, NEO_GRBW + NEO_KHZ800);
+    report("LedStrip::updateSegment (RGBW)", leds, measure([&]() {
+               rgbw.updateSegment(colors, 0, leds);
+               rgbw.publish();
+           }));
+
+    strip.setBrightness(128);
+    strip.setGamma(2.2f);
+    strip.setWhitePoint(Color(255, 120, 120));
+    report("LedStrip::draw (pipeline)", leds, measure([&]() {
+               touch(strip);
+               strip.draw();
+           }));
+    strip.setDithering(true);
+    report("LedStrip::draw (dithering)", leds,
+           measure([&]() { strip.draw(); }));
+    strip.setDithering(false);
+    strip.setBrightness(255);
+    strip.setGamma(1.0f);
+    strip.setWhitePoint(Color::WHITE);
+
+    // Frame rate bound by the simulated wire time of a WS2812 strip
+    MockLedOutput *output = new MockLedOutput(NEO_KHZ800);
+    strip.setOutput(output);
+    report("LedStrip::draw (mock wire)", leds, measure([&]() {
+               touch(strip);
+               strip.draw();
+           }));
+}
+
+// Four strips on their own pins drawn through one canvas
+static void bench_strips(uint16_t leds) {
+    const uint16_t num_strips = 4;
+    uint16_t strip_leds = leds / num_strips;
+    LedStripsManager manager(num_strips);
+    for (uint16_t i = 0; i < num_strips; i++) {
+        uint16_t id = manager.addLedStrip(strip_leds, i, NEO_RBG + NEO_KHZ800);
+        manager.getLedStrip(id)->setOutput(new MockLedOutput(NEO_KHZ800));
+    }
+    LedCanvas *canvas = manager.createCanvas();
+    LedsList colors(canvas->getNumPixels());
+    report("LedStripsManager (4 pins)", leds, measure([&]() {
+               canvas->updatePixels(colors);
+               touch(*canvas);
+               manager.update();
+           }));
+    delete canvas;
+}
+
+// Three effects stacked on one strip, compare with the single effects above
+static void bench_compositor(uint16_t leds) {
+    LedStrip strip(leds, 0, NEO_RBG + NEO_KHZ800);
+    Compositor compositor(&strip);
+    LedLayer *layer = compositor.addLayer(BLEND_ALPHA);
+    Sparks<uint8_t> *sparks =
+        new Sparks<uint8_t>(layer, Palette(255, Color::WHITE, Color::WHITE));
+    sparks->setNumOfSparks(0.75f);
+    sparks->setSparkValue(255);
+    layer->setEffect(sparks);
+    layer = compositor.addLayer(BLEND_SCREEN, 128);
+    Roll<uint8_t> *roll = new Roll<uint8_t>(layer, RainbowPalette(8));
+    roll->setMaxHeat(8);
+    roll->setSpeed(0.1f);
+    roll->setRollSpeed(1.0f);
+    layer->setEffect(roll);
+    layer = compositor.addLayer(BLEND_ADD);
+    Pulses<uint8_t> *pulses = new Pulses<uint8_t>(layer, RainbowPalette(255));
+    pulses->setMaxHeat(255);
+    pulses->setSpeed(1);
+    layer->setEffect(pulses);
+    report("Compositor (3 layers)", leds,
+           measure([&]() { compositor.update(EFFECT_TICK_US); }));
+}
+
+// Sparks over the whole strip and four Sparks on disjoint segments of it,
+// rendered with and without worker tasks helping the manager
+static void bench_effects(uint16_t leds) {
+    LedStrip strip(leds, 0, NEO_RBG + NEO_KHZ800);
+    ILedStrip *segments[4];
+    const char *names[2][3] = {
+        {"EffectsManager (1 effect)", "EffectsManager (1 worker)",
+         "EffectsManager (3 workers)"},
+        {"EffectsManager (4 effects)", "EffectsManager (1 worker)",
+         "EffectsManager (3 workers)"}};
+    for (uint32_t run = 0; run < 6; run++) {
+        const uint16_t num_effects = run < 3 ? 1 : 4;
+        const uint32_t workers = run % 3 == 0 ? 0 : run % 3 == 1 ? 1 : 3;
+        uint16_t part = leds / num_effects;
+        EffectsManager manager(num_effects);
+        for (uint16_t i = 0; i < num_effects; i++) {
+            segments[i] = strip.GetSegment(i * part, (i + 1) * part);
+            Sparks<uint8_t> *effect =
+                new Sparks<uint8_t>(segments[i], palettes::WHITE);
+            effect->setNumOfSparks(0.75f);
+            effect->setSparkValue(255);
+            manager.AddEffect(effect);
+        }
+        manager.setWorkers(workers);
+        manager.setup();
+        report(names[run / 3][run % 3], leds,
+               measure([&]() { manager.update(); }));
+        manager.cleanup();
+        for (uint16_t i = 0; i < num_effects; i++) {
+            strip.ReleaseSegment(segments[i]);
+        }
+    }
+}
+
+// The steady state frame loop must not touch the heap
+static void check_allocations(uint16_t leds) {
+    LedStrip strip(leds, 0, NEO_RBG + NEO_KHZ800);
+    strip.setOutput(new MockLedOutput(NEO_KHZ800));
+    strip.setBrightness(200);
+    EffectsManager manager(2);
+    Sparks<uint8_t> *sparks =
+        new Sparks<uint8_t>(strip.GetSegment(0, leds / 2),
+                            Palette(255, Color::WHITE, Color::WHITE));
+    sparks->setNumOfSparks(0.75f);
+    sparks->setSparkValue(255);
+    manager.AddEffect(sparks);
+    Compositor *compositor = new Compositor(strip.GetSegment(leds / 2, leds));
+    LedLayer *layer = compositor->addLayer(BLEND_ADD);
+    layer->setEffect(new Pulses<uint8_t>(layer, RainbowPalette(255)));
+    manager.AddEffect(compositor);
+    manager.setup();
+
+    const uint32_t frames = 100;
+    // The first frames allocate the output buffers
+    for (uint32_t i = 0; i < 4; i++) {
+        manager.update();
+        strip.waitDrawn();
+        strip.draw();
+    }
+    uint64_t start = alloc_count();
+    for (uint32_t i = 0; i < frames; i++) {
+        manager.update();
+        strip.waitDrawn();
+        strip.draw();
+    }
+    uint64_t count = alloc_count() - start;
+    printf("%-28s %6u %12.2f\n", "allocations/frame", leds,
+           (double)count / frames);
+    expect(count == 0, "allocations/frame", leds);
+    manager.cleanup();
+}
+
+// An assigned palette must look up its own table, not the one of the palette
+// it was assigned from
+static void check_palette_copy(void) {
+    Palette reference = RainbowPalette(8);
+    Palette assigned(palettes::WHITE);
+    {
+        Palette source = RainbowPalette(8);
+        assigned = source;
+        // Reuse the freed table of source
+        Palette other(8, Color::WHITE, Color::WHITE);
+        (void)other;
+    }
+    uint32_t mismatches = 0;
+    for (uint32_t i = 0; i <= 8; i++) {
+        Color expected;
+        Color color;
+        reference.lookup(i, expected);
+        assigned.lookup(i, color);
+        if (color.Value() != expected.Value()) {
+            mismatches++;
+        }
+    }
+    printf("%-28s %6s %12u\n", "palette copy bad colors", "",
+           (unsigned)mismatches);
+    expect(mismatches == 0, "palette copy bad colors", 0);
+}
+
+// Effects with the same seed render the same frames
+static void check_replay(uint16_t leds) {
+    LedLayer first(leds, BLEND_ADD, 255);
+    LedLayer second(leds, BLEND_ADD, 255);
+    LedLayer *layers[] = {&first, &second};
+    for (size_t i = 0; i < COUNT_OF(layers); i++) {
+        Sparks<uint8_t> *sparks = new Sparks<uint8_t>(
+            layers[i], Palette(255, Color::WHITE, Color::WHITE));
+        sparks->setColdDown(-2.5f);
+        sparks->setNumOfSparks(3.5f);
+        sparks->setSparkValue(255);
+        sparks->setMaxHeat(255);
+        sparks->setSeed(42);
+        layers[i]->setEffect(sparks);
+    }
+    uint32_t mismatches = 0;
+    for (uint32_t frame = 0; frame < 100; frame++) {
+        first.getEffect()->update(EFFECT_TICK_US);
+        second.getEffect()->update(EFFECT_TICK_US);
+        if (memcmp((const void *)first.getPixels().data(),
+                   (const void *)second.getPixels().data(),
+                   sizeof(::Color) * leds) != 0) {
+            mismatches++;
+        }
+    }
+    printf("%-28s %6u %12u\n", "replay mismatched frames", leds,
+           (unsigned)mismatches);
+    expect(mismatches == 0, "replay mismatched frames", leds);
+}
+
+// A recording of Sparks with keyframes played back on a strip must show the
+// frames rendered by the same Sparks, as the strip only gets the changes
+static void check_playback(uint16_t leds) {
+    FILE *file = tmpfile();
+    FrameRecorder *recorder =
+        new FrameRecorder(new FileFrameSink(file), leds, 60, 30);
+    LedLayer layer(leds, BLEND_ADD, 255);
+    EffectBase *effects[] = {
+        new Sparks<uint8_t>(recorder, RainbowPalette(255)),
+        new Sparks<uint8_t>(&layer, RainbowPalette(255))};
+    for (size_t i = 0; i < COUNT_OF(effects); i++) {
+        Sparks<uint8_t> *sparks = (Sparks<uint8_t> *)effects[i];
+        sparks->setMaxHeat(255);
+        sparks->setColdDown(-2.5f);
+        sparks->setNumOfSparks(3.5f);
+        sparks->setSparkValue(255);
+        sparks->setSeed(7);
+    }
+    layer.setEffect(effects[1]);
+    const uint32_t frames = 100;
+    ArrayList<::Color> reference(frames * leds);
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        effects[0]->update(EFFECT_TICK_US);
+        recorder->recordFrame();
+        effects[1]->update(EFFECT_TICK_US);
+        memcpy((void *)(reference.data() + frame * leds),
+               (const void *)layer.getPixels().data(), sizeof(::Color) * leds);
+    }
+    ArrayList<uint8_t> data(recorder->getEncoder().getSize());
+    fflush(file);
+    rewind(file);
+    size_t size = fread(data.data(), 1, data.count(), file);
+    LedStrip strip(leds, 0, NEO_RGB + NEO_KHZ800);
+    MockLedOutput *output = new MockLedOutput(NEO_KHZ800);
+    strip.setOutput(output);
+    PlaybackEffect playback(&strip,
+                            new MemoryFrameSource(data.data(), size));
+    uint32_t mismatches = 0;
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        playback.update(1000000 / 60);
+        playback.publish();
+        strip.waitDrawn();
+        strip.draw();
+        const uint8_t *wire = output->getLastFrame().data();
+        const ::Color *expected = reference.data() + frame * leds;
+        for (uint16_t i = 0; i < leds; i++) {
+            if (wire[3 * i] != expected[i].R() ||
+                wire[3 * i + 1] != expected[i].G() ||
+                wire[3 * i + 2] != expected[i].B()) {
+                mismatches++;
+                break;
+            }
+        }
+    }
+    printf("%-28s %6u %12u\n", "playback bad frames", leds,
+           (unsigned)mismatches);
+    expect(mismatches == 0 && playback.getPlayedFrames() == frames,
+           "playback bad frames", leds);
+    delete recorder;
+}
+
+// Split rendering in uneven ranges, out of order, must match update() while
+// the heat field scrolls its origin around
+static void check_split(uint16_t leds) {
+    LedLayer whole(leds, BLEND_ADD, 255);
+    LedLayer split(leds, BLEND_ADD, 255);
+    LedLayer *layers[] = {&whole, &split};
+    for (size_t i = 0; i < COUNT_OF(layers); i++) {
+        Roll<uint8_t> *roll = new Roll<uint8_t>(layers[i], RainbowPalette(8));
+        roll->setMaxHeat(8);
+        roll->setSpeed(0.1f);
+        roll->setRollSpeed(7.0f);
+        layers[i]->setEffect(roll);
+    }
+    const uint16_t bounds[] = {0, (uint16_t)(leds / 3), (uint16_t)(leds / 2),
+                               leds};
+    uint32_t mismatches = 0;
+    for (uint32_t frame = 0; frame < 100; frame++) {
+        whole.getEffect()->update(EFFECT_TICK_US);
+        EffectBase *effect = split.getEffect();
+        effect->step(EFFECT_TICK_US);
+        for (size_t i = COUNT_OF(bounds) - 1; i > 0; i--) {
+            effect->render(bounds[i - 1], bounds[i]);
+        }
+        if (memcmp((const void *)whole.getPixels().data(),
+                   (const void *)split.getPixels().data(),
+                   sizeof(::Color) * leds) != 0) {
+            mismatches++;
+        }
+    }
+    printf("%-28s %6u %12u\n", "split mismatched frames", leds,
+           (unsigned)mismatches);
+    expect(mismatches == 0, "split mismatched frames", leds);
+}
+
+// 16-bit heat above the integer range of Q16_16. Pulses and Roll are stepped
+// up to 36000 of 40000 and the sparks set to 40000, through a black to white
+// palette over the whole range.
+static void check_heat_range(void) {
+    const uint16_t leds = 16;
+    Palette palette(40000, Color::WHITE, Color::WHITE);
+    LedLayer layers[] = {LedLayer(leds, BLEND_ADD, 255),
+                         LedLayer(leds, BLEND_ADD, 255),
+                         LedLayer(leds, BLEND_ADD, 255)};
+    Pulses<uint16_t> *pulses = new Pulses<uint16_t>(&layers[0], palette);
+    pulses->setMaxHeat(40000);
+    pulses->setSpeed(1000.0f);
+    layers[0].setEffect(pulses);
+    Roll<uint16_t> *roll = new Roll<uint16_t>(&layers[1], palette);
+    roll->setMaxHeat(40000);
+    roll->setSpeed(1000.0f);
+    roll->setRollSpeed(1.0f);
+    layers[1].setEffect(roll);
+    Sparks<uint16_t> *sparks = new Sparks<uint16_t>(&layers[2], palette);
+    sparks->setMaxHeat(40000);
+    sparks->setNumOfSparks(4.0f);
+    sparks->setSparkValue(40000.0f);
+    layers[2].setEffect(sparks);
+    // 36 ticks in one step, then one tick
+    for (size_t i = 0; i < COUNT_OF(layers); i++) {
+        layers[i].getEffect()->update(35 * EFFECT_TICK_US);
+        layers[i].getEffect()->update(EFFECT_TICK_US);
+    }
+    Color expected;
+    palette.lookup(36000, expected);
+    uint8_t brightest = 0;
+    for (uint16_t i = 0; i < leds; i++) {
+        uint8_t value = layers[2].getPixels()[i].R();
+        brightest = value > brightest ? value : brightest;
+    }
+    uint8_t values[] = {layers[0].getPixels()[0].R(),
+                        layers[1].getPixels()[0].R(), brightest};
+    printf("%-28s %6u %12u %12u %12u\n", "heat 36000/40000 (R)", leds,
+           (unsigned)values[0], (unsigned)values[1], (unsigned)values[2]);
+    expect(values[0] == expected.R() && values[1] == expected.R() &&
+               values[2] == 255,
+           "heat 36000/40000 (R)", leds);
+}
+
+// Render effects for two seconds at lower frame rates and compare with 60
+// fps. Roll and Pulses must end on the same frame, Sparks is random so its
+// mean brightness is compared.
+static void check_frame_rate(uint16_t leds) {
+    const uint32_t rates[] = {60, 30, 20, 15};
+    LedsList reference(leds);
+    for (int kind = 0; kind < 3; kind++) {
+        for (size_t r = 0; r < COUNT_OF(rates); r++) {
+            LedLayer layer(leds, BLEND_ADD, 255);
+            if (kind == 0) {
+                Roll<uint8_t> *roll =
+                    new Roll<uint8_t>(&layer, RainbowPalette(8));
+                roll->setMaxHeat(8);
+                roll->setSpeed(0.1f);
+                roll->setRollSpeed(1.0f);
+                layer.setEffect(roll);
+            } else if (kind == 1) {
+                Pulses<uint8_t> *pulses =
+                    new Pulses<uint8_t>(&layer, RainbowPalette(255));
+                pulses->setMaxHeat(255);
+                pulses->setSpeed(1.5f);
+                layer.setEffect(pulses);
+            } else {
+                Sparks<uint8_t> *sparks =
+                    new Sparks<uint8_t>(&layer, palettes::WHITE);
+                sparks->setMaxHeat(255);
+                sparks->setColdDown(-2.5f);
+                sparks->setNumOfSparks(0.75f);
+                sparks->setSparkValue(255);
+                layer.setEffect(sparks);
+            }
+            // Same time steps the scheduler gives, 120 ticks in total
+            uint32_t frames = 2 * rates[r];
+            for (uint32_t i = 0; i < frames; i++) {
+                uint32_t dt = (uint32_t)((i + 1) * 2000000ULL / frames -
+                                         i * 2000000ULL / frames);
+                layer.getEffect()->update(dt);
+            }
+            LedsSpan pixels = layer.getPixels();
+            if (r == 0) {
+                memcpy((void *)reference.data(), (const void *)pixels.data(),
+                       sizeof(::Color) * leds);
+                continue;
+            }
+            char name[32];
+            const char *names[] = {"Roll", "Pulses", "Sparks"};
+            if (kind < 2) {
+                uint32_t mismatches = 0;
+                for (uint16_t i = 0; i < leds; i++) {
+                    if (pixels[i].R() != reference[i].R() ||
+                        pixels[i].G() != reference[i].G() ||
+                        pixels[i].B() != reference[i].B()) {
+                        mismatches++;
+                    }
+                }
+                snprintf(name, sizeof(name), "%s %u fps (bad px)",
+                         names[kind], (unsigned)rates[r]);
+                printf("%-28s %6u %12u\n", name, leds, (unsigned)mismatches);
+                expect(mismatches == 0, name, leds);
+            } else {
+                uint64_t sum = 0;
+                uint64_t reference_sum = 0;
+                for (uint16_t i = 0; i < leds; i++) {
+                    sum += pixels[i].R();
+                    reference_sum += reference[i].R();
+                }
+                snprintf(name, sizeof(name), "%s %u fps (%% of 60)",
+                         names[kind], (unsigned)rates[r]);
+                double percent =
+                    reference_sum ? 100.0 * sum / reference_sum : 0.0;
+                printf("%-28s %6u %12.1f\n", name, leds, percent);
+                // Random, but the mean must stay close
+                expect(percent > 90.0 && percent < 110.0, name, leds);
+            }
+        }
+    }
+}
+
+// Task counting its frames
+class CountingTask : public ITaskManager {
+  public:
+    CountingTask(uint32_t rate) : ITaskManager(rate), m_updates(0) {}
+
+    uint32_t getUpdates(void) const { return m_updates; }
+
+  protected:
+    void setup(void) {}
+    void update(void) { m_updates++; }
+    void cleanup(void) {}
+
+  private:
+    std::atomic<uint32_t> m_updates;
+};
+
+// Stop a task and wait until it ended, false on a timeout
+static bool stop_task(ITaskManager &task) {
+    task.stop();
+    Clock::time_point timeout = Clock::now() + std::chrono::seconds(1);
+    while (task.isRunning()) {
+        if (Clock::now() > timeout) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// Start, stop and start a task again as the firmware does when switching
+// inputs. The scheduler timer must wake the new task, not the deleted one.
+static void check_restart(void) {
+    const uint32_t rate = 200;
+    CountingTask task(rate);
+    uint32_t frames[2];
+    bool stopped = true;
+    for (int run = 0; run < 2; run++) {
+        uint32_t start = task.getUpdates();
+        task.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        stopped = stop_task(task) && stopped;
+        frames[run] = task.getUpdates() - start;
+    }
+    printf("%-28s %6s %12u %12u\n", "task frames/restarted", "",
+           (unsigned)frames[0], (unsigned)frames[1]);
+    // 20 frames are due in 100 ms
+    expect(stopped && frames[0] >= 10 && frames[1] >= 10,
+           "task frames/restarted", 0);
+}
+
+// Effect keeping the step of its last update
+class StepEffect : public EffectBase {
+  public:
+    StepEffect(ILedStrip *led_strip)
+        : EffectBase(led_strip, palettes::WHITE), m_dt_us(0) {}
+
+    uint32_t getStep(void) const { return m_dt_us; }
+    void update(uint32_t dt_us) { m_dt_us = dt_us; }
+
+  private:
+    uint32_t m_dt_us;
+};
+
+// A manager without a refresh rate steps its first frame by one tick
+static void check_zero_rate(void) {
+    LedStrip strip(8, 0, NEO_RBG + NEO_KHZ800);
+    StepEffect *effect = new StepEffect(strip.GetSegment(0, 8));
+    EffectsManager manager(1, 0);
+    manager.AddEffect(effect);
+    manager.update();
+    printf("%-28s %6s %12u\n", "first step/rate 0", "",
+           (unsigned)effect->getStep());
+    expect(effect->getStep() == EFFECT_TICK_US, "first step/rate 0", 0);
+}
+
+// Frame with every pixel changed, as R, G, B bytes
+static void network_pattern(uint8_t *rgb, uint16_t leds, uint32_t frame) {
+    for (uint32_t i = 0; i < leds; i++) {
+        rgb[3 * i] = (uint8_t)(i + frame);
+        rgb[3 * i + 1] = (uint8_t)(i * 3 + frame);
+        rgb[3 * i + 2] = (uint8_t)(i * 7 + frame);
+    }
+}
+
+// Send frames to a NetworkInput over loopback UDP and compare what the strip
+// sends out, time spent receiving is reported per pixel
+static void check_network(uint16_t leds) {
+    const uint16_t ddp_port = 14048;
+    const uint16_t e131_port = 15568;
+    const uint32_t frames = 120;
+    LedStrip strip(leds, 0, NEO_GRB + NEO_KHZ800);
+    MockLedOutput *output = new MockLedOutput(NEO_KHZ800);
+    strip.setOutput(output);
+    NetworkInput input(ddp_port, e131_port);
+    input.addStrip(&strip);
+    uint16_t universes = (leds + E131_PIXELS_PER_UNIVERSE - 1) /
+                         E131_PIXELS_PER_UNIVERSE;
+    input.mapUniverses(1, universes);
+    if (!input.begin()) {
+        printf("%-28s %6u %12s\n", "network", leds, "no sockets");
+        return;
+    }
+    int sender = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ArrayList<uint8_t> rgb(3 * leds);
+    uint8_t packet[NETWORK_INPUT_PACKET_SIZE];
+
+    for (int e131 = 0; e131 < 2; e131++) {
+        addr.sin_port = htons(e131 ? e131_port : ddp_port);
+        uint32_t mismatches = 0;
+        uint64_t receive_ns = 0;
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            network_pattern(rgb.data(), leds, frame);
+            uint32_t per_packet = e131 ? E131_PIXELS_PER_UNIVERSE : 480;
+            for (uint32_t first = 0; first < leds; first += per_packet) {
+                uint16_t count = leds - first < per_packet ? leds - first
+                                                           : per_packet;
+                const uint8_t *data = rgb.data() + 3 * first;
+                size_t size =
+                    e131 ? BuildE131Packet(packet, sizeof(packet), frame,
+                                           1 + first / per_packet, 1, data,
+                                           count)
+                         : BuildDdpPacket(packet, sizeof(packet), frame + 1,
+                                          first, data, count,
+                                          first + count == leds);
+                sendto(sender, packet, size, 0, (struct sockaddr *)&addr,
+                       sizeof(addr));
+            }
+            if (e131) {
+                size_t size = BuildE131Sync(packet, sizeof(packet), frame, 1);
+                sendto(sender, packet, size, 0, (struct sockaddr *)&addr,
+                       sizeof(addr));
+            }
+            Clock::time_point start = Clock::now();
+            input.poll();
+            receive_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              Clock::now() - start)
+                              .count();
+            strip.waitDrawn();
+            strip.draw();
+            const uint8_t *wire = output->getLastFrame().data();
+            for (uint32_t i = 0; i < leds; i++) {
+                const uint8_t *p = rgb.data() + 3 * i;
+                if (wire[3 * i] != p[1] || wire[3 * i + 1] != p[0] ||
+                    wire[3 * i + 2] != p[2]) {
+                    mismatches++;
+                    break;
+                }
+            }
+        }
+        const char *name =
+            e131 ? "network e1.31 (bad frames)" : "network ddp (bad frames)";
+        printf("%-28s %6u %12.2f %12u\n", name, leds,
+               (double)receive_ns / frames / leds, (unsigned)mismatches);
+        expect(mismatches == 0, name, leds);
+    }
+    const NetworkInputStats &stats = input.getStats();
+    printf("%-28s %6u %12u %12u\n", "network frames/out of order", leds,
+           (unsigned)stats.frames, (unsigned)stats.out_of_order);
+    expect(stats.frames == 2 * frames && stats.out_of_order == 0,
+           "network frames/out of order", leds);
+
+    // Pixels that are not RGB8 and a sync older than the last one must not
+    // reach the strip
+    uint32_t ignored = stats.ignored;
+    uint32_t out_of_order = stats.out_of_order;
+    size_t size = BuildDdpPacket(packet, sizeof(packet), 0, 0, rgb.data(),
+                                 leds < 480 ? leds : 480, true);
+    packet[2] = 0x1b;
+    bool ddp_rejected = !input.handleDdp(packet, size);
+    size = BuildE131Sync(packet, sizeof(packet), frames - 2, 1);
+    bool sync_rejected = !input.handleE131(packet, size);
+    printf("%-28s %6u %12u %12u\n", "network rejected ddp/sync", leds,
+           (unsigned)(stats.ignored - ignored),
+           (unsigned)(stats.out_of_order - out_of_order));
+    expect(ddp_rejected && sync_rejected && stats.frames == 2 * frames &&
+               stats.ignored == ignored + 1 &&
+               stats.out_of_order == out_of_order + 1,
+           "network rejected ddp/sync", leds);
+
+    // The task sleeps on the sockets, a pushed frame is published right away
+    // and stop() returns within the receive timeout
+    input.start();
+    delay(20);
+    addr.sin_port = htons(ddp_port);
+    size = BuildDdpPacket(packet, sizeof(packet), 0, 0, rgb.data(),
+                          leds < 480 ? leds : 480, true);
+    Clock::time_point start = Clock::now();
+    sendto(sender, packet, size, 0, (struct sockaddr *)&addr, sizeof(addr));
+    while (stats.frames == 2 * frames &&
+           Clock::now() - start < std::chrono::seconds(1)) {
+        std::this_thread::yield();
+    }
+    double latency_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                            Clock::now() - start)
+                            .count();
+    input.stop();
+    start = Clock::now();
+    while (input.isRunning() &&
+           Clock::now() - start < std::chrono::seconds(1)) {
+        delay(1);
+    }
+    double stop_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         Clock::now() - start)
+                         .count();
+    printf("%-28s %6u %12.0f %12.0f\n", "network task us/stop ms",
+           leds, latency_us, stop_ms);
+    expect(stats.frames == 2 * frames + 1 && !input.isRunning(),
+           "network task us/stop ms", leds);
+    close(sender);
+}
+
+// Write a packet to the master side of the pty and poll input on the slave
+// side until it handled the packet
+static void serial_send(int master, SerialInput &input,
+                            const uint8_t *data, size_t len) {
+    const SerialInputStats &stats = input.getStats();
+    uint32_t handled = stats.packets + stats.errors;
+    Clock::time_point timeout = Clock::now() + std::chrono::seconds(1);
+    while (true) {
+        ssize_t written = len > 0 ? write(master, data, len) : 0;
+        if (written > 0) {
+            data += written;
+            len -= written;
+        }
+        uint32_t read = input.poll();
+        // The pty hands written bytes to the slave side asynchronously
+        if (len == 0 && read == 0 &&
+            (stats.packets + stats.errors != handled ||
+             Clock::now() > timeout)) {
+            return;
+        }
+    }
+}
+
+// Stream frames to a SerialInput through a pty and compare what the strip
+// sends out. Adalight frames, extended frames in two packets and delta frames
+// changing every 8th pixel are sent, every 10th delta is corrupted first and
+// must leave the strip unchanged.
+static void check_serial(uint16_t leds) {
+    const uint32_t frames = 120;
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    int slave = -1;
+    if (master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0) {
+        slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    }
+    if (slave < 0 || !SetRawMode(slave)) {
+        printf("%-28s %6u %12s\n", "serial", leds, "no pty");
+        return;
+    }
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    FdStream stream(slave);
+    LedStrip strip(leds, 0, NEO_GRB + NEO_KHZ800);
+    MockLedOutput *output = new MockLedOutput(NEO_KHZ800);
+    strip.setOutput(output);
+    SerialInput input(&stream);
+    input.addStrip(&strip);
+    ArrayList<uint8_t> rgb(3 * leds);
+    ArrayList<uint8_t> previous(3 * leds);
+    memset(previous.data(), 0, previous.count());
+    ArrayList<uint8_t> packet(SERIAL_HEADER_SIZE + 4 * leds);
+    // True if the strip sent expected, in GRB order
+    auto sent = [&](const uint8_t *expected) {
+        strip.waitDrawn();
+        strip.draw();
+        const uint8_t *wire = output->getLastFrame().data();
+        for (uint32_t i = 0; i < leds; i++) {
+            const uint8_t *p = expected + 3 * i;
+            if (wire[3 * i] != p[1] || wire[3 * i + 1] != p[0] ||
+                wire[3 * i + 2] != p[2]) {
+                return false;
+            }
+        }
+        return true;
+    };
+    const char *names[] = {"serial adalight (bad frames)",
+                           "serial frame (bad frames)",
+                           "serial delta (bad frames)"};
+
+    for (int mode = 0; mode < 3; mode++) {
+        uint32_t mismatches = 0;
+        uint64_t bytes = 0;
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            if (mode < 2) {
+                network_pattern(rgb.data(), leds, frame);
+            } else {
+                for (uint32_t i = frame % 8; i < leds; i += 8) {
+                    rgb[3 * i] = (uint8_t)(rgb[3 * i] + 1);
+                }
+            }
+            if (mode == 0) {
+                size_t size = BuildAdalightHeader(packet.data(), leds);
+                memcpy(packet.data() + size, rgb.data(), 3 * leds);
+                size += 3 * leds;
+                serial_send(master, input, packet.data(), size);
+                bytes += size;
+            } else if (mode == 1) {
+                uint16_t half = leds / 2;
+                for (int part = 0; part < 2; part++) {
+                    uint16_t first = part ? half : 0;
+                    uint16_t count = part ? leds - half : half;
+                    size_t size = BuildSerialFrame(
+                        packet.data(), packet.count(), first,
+                        rgb.data() + 3 * first, count, part == 1);
+                    serial_send(master, input, packet.data(), size);
+                    bytes += size;
+                }
+            } else {
+                size_t size = BuildSerialDelta(
+                    packet.data(), packet.count(), 0, rgb.data(),
+                    previous.data(), leds, true);
+                if (frame % 10 == 0) {
+                    // The last pixel, corrupting a token could make the
+                    // packet swallow the next one
+                    uint8_t *pixel = &packet[size - SERIAL_CHECKSUM_SIZE - 1];
+                    *pixel ^= 0x10;
+                    serial_send(master, input, packet.data(), size);
+                    *pixel ^= 0x10;
+                    if (!sent(previous.data())) {
+                        mismatches++;
+                    }
+                }
+                serial_send(master, input, packet.data(), size);
+                bytes += size;
+            }
+            memcpy(previous.data(), rgb.data(), rgb.count());
+            if (!sent(rgb.data())) {
+                mismatches++;
+            }
+        }
+        printf("%-28s %6u %12s %12u\n", names[mode], leds, "",
+               (unsigned)mismatches);
+        expect(mismatches == 0, names[mode], leds);
+        printf("%-28s %6u %12.2f\n", "serial bytes/pixel", leds,
+               (double)bytes / frames / leds);
+    }
+    const SerialInputStats &stats = input.getStats();
+    printf("%-28s %6u %12u %12u\n", "serial frames/errors", leds,
+           (unsigned)stats.frames, (unsigned)stats.errors);
+    // Only the corrupted deltas may fail
+    expect(stats.frames == 3 * frames && stats.errors == frames / 10,
+           "serial frames/errors", leds);
+
+    // The task sleeps until the receive callback, standing in for the one
+    // of the port, wakes it. A frame is published right away and stop()
+    // returns within the timeout.
+    input.start();
+    delay(20);
+    TaskStats idle;
+    input.ITaskManager::getStats(idle);
+    size_t size = BuildSerialFrame(packet.data(), packet.count(), 0,
+                                   rgb.data(), leds, true);
+    Clock::time_point start = Clock::now();
+    for (size_t done = 0; done < size;) {
+        ssize_t written = write(master, packet.data() + done, size - done);
+        done += written > 0 ? written : 0;
+        if (stream.available() > 0) {
+            input.notifyReceived();
+        }
+    }
+    while (stats.frames == 3 * frames &&
+           Clock::now() - start < std::chrono::seconds(1)) {
+        if (stream.available() > 0) {
+            input.notifyReceived();
+        }
+        std::this_thread::yield();
+    }
+    double latency_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                            Clock::now() - start)
+                            .count();
+    input.stop();
+    start = Clock::now();
+    while (input.isRunning() &&
+           Clock::now() - start < std::chrono::seconds(1)) {
+        delay(1);
+    }
+    double stop_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                         Clock::now() - start)
+                         .count();
+    printf("%-28s %6u %12.0f %12.0f\n", "serial task us/stop ms", leds,
+           latency_us, stop_ms);
+    expect(stats.frames == 3 * frames + 1 && !input.isRunning(),
+           "serial task us/stop ms", leds);
+    // Idle for 20 ms, at most one timeout may have passed
+    printf("%-28s %6u %12u\n", "serial task idle wake ups", leds,
+           (unsigned)idle.frames);
+    expect(idle.frames <= 1, "serial task idle wake ups", leds);
+    close(slave);
+    close(master);
+}
+
+// Heap allocations made building a strip with effects, with and without the
+// arenas
+static void check_arena(uint16_t leds) {
+    uint64_t heap_allocs[2];
+    for (int scoped = 0; scoped < 2; scoped++) {
+        uint64_t start = alloc_count();
+        ArenaScope *arena = scoped ? new ArenaScope() : nullptr;
+        LedStrip *strip = new LedStrip(leds, 0, NEO_RBG + NEO_KHZ800);
+        EffectsManager *manager = new EffectsManager(2);
+        manager->AddEffect(new Sparks<uint8_t>(strip->GetSegment(0, leds / 2),
+                                               RainbowPalette(255)));
+        manager->AddEffect(new Roll<uint8_t>(
+            strip->GetSegment(leds / 2, leds), RainbowPalette(8)));
+        delete arena;
+        heap_allocs[scoped] = alloc_count() - start;
+        printf("%-28s %6u %12u\n",
+               scoped ? "setup heap allocs (arena)" : "setup heap allocs", leds,
+               (unsigned)heap_allocs[scoped]);
+        delete manager;
+        delete strip;
+    }
+    expect(heap_allocs[1] < heap_allocs[0], "setup heap allocs (arena)", leds);
+}
+
+// Adding effects past num_of_effects grows the lists geometrically, not on
+// every add
+static void check_effect_list(void) {
+    const uint16_t num_effects = 16;
+    LedStrip strip(num_effects, 0, NEO_RBG + NEO_KHZ800);
+    EffectBase *effects[num_effects];
+    for (uint16_t i = 0; i < num_effects; i++) {
+        effects[i] = new Roll<uint8_t>(strip.GetSegment(i, i + 1),
+                                       RainbowPalette(8));
+    }
+    EffectsManager manager(1);
+    uint64_t start = alloc_count();
+    for (uint16_t i = 0; i < num_effects; i++) {
+        manager.AddEffect(effects[i]);
+    }
+    uint64_t count = alloc_count() - start;
+    printf("%-28s %6u %12u\n", "effect list allocs", num_effects,
+           (unsigned)count);
+    // 1 -> 2 -> 4 -> 8 -> 16 for both lists
+    expect(count <= 8, "effect list allocs", num_effects);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        g_min_time_ms = (uint32_t)atoi(argv[1]);
+    }
+
+    printf("%-28s %6s %12s %12s\n", "benchmark", "leds", "ns/pixel",
+           "frames/sec");
+    for (size_t i = 0; i < COUNT_OF(STRIP_LENGTHS); i++) {
+        uint16_t leds = STRIP_LENGTHS[i];
+        bench_palette(leds);
+        bench_kernels(leds);
+        bench_heat<uint8_t>("HeatBase<uint8_t>::update", leds);
+        bench_heat<uint32_t>("HeatBase<uint32_t>::update", leds);
+        bench_sparks(leds);
+        bench_random(leds);
+        bench_playback(leds);
+        bench_serial(leds);
+        bench_roll(leds);
+        bench_pulses(leds);
+        bench_compositor(leds);
+        bench_strip(leds);
+        bench_strips(leds);
+        bench_effects(leds);
+        check_allocations(leds);
+    }
+    check_palette_copy();
+    check_replay(250);
+    check_split(1000);
+    check_playback(1000);
+    check_frame_rate(1000);
+    check_heat_range();
+    check_restart();
+    check_zero_rate();
+    check_network(4000);
+    check_serial(4000);
+    check_arena(250);
+    check_effect_list();
+    led_memory_report();
+    if (g_failures > 0) {
+        printf("%u checks failed\n", (unsigned)g_failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <FreeRTOS.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <task.h>
+
+// Size of the arena for buffers touched every frame, reserved in internal
+// SRAM at link time. 0 disables it.
+#ifndef LED_ARENA_HOT_SIZE
+#define LED_ARENA_HOT_SIZE (48 * 1024)
+#endif
+// Size of the arena for everything else, taken from PSRAM when the board has
+// it and from the heap otherwise, once on the first ArenaScope
+#ifndef LED_ARENA_COLD_SIZE
+#define LED_ARENA_COLD_SIZE (32 * 1024)
+#endif
+
+enum MemoryRegion {
+    // Pixel buffers, tables and state read or written on every frame
+    MEMORY_HOT,
+    // Objects and data only used at setup or now and then
+    MEMORY_COLD,
+};
+
+/**
+ * Bump allocator over a fixed buffer. Blocks are never given back one by one,
+ * free() only forgets them, so the arena never fragments. Meant for buffers
+ * living as long as the program.
+ */
+class Arena {
+  public:
+    Arena(const char *name, uint8_t *buffer, size_t size);
+
+    // nullptr when the arena is full
+    void *allocate(size_t size);
+    // Grows the block in place if it is the last one, otherwise moves it.
+    // nullptr when the arena is full, ptr is then left untouched.
+    void *reallocate(void *ptr, size_t size);
+    // Only the last block is given back, so temporaries freed right after
+    // they were made do not waste the arena
+    void release(void *ptr);
+    bool owns(const void *ptr) const {
+        return m_buffer <= (const uint8_t *)ptr &&
+               (const uint8_t *)ptr < m_buffer + m_size;
+    }
+
+    const char *getName(void) const { return m_name; }
+    size_t getSize(void) const { return m_size; }
+    size_t getUsed(void) const { return m_used; }
+    uint32_t getAllocations(void) const { return m_allocations; }
+    // Requests served by the heap because the arena was full
+    uint32_t getFallbacks(void) const { return m_fallbacks; }
+    void addFallback(void) { m_fallbacks++; }
+
+    static Arena *hot(void);
+    static Arena *cold(void);
+
+  private:
+    const char *m_name;
+    uint8_t *m_buffer;
+    size_t m_size;
+    size_t m_used;
+    // Offset of the last block, the only one that can grow in place
+    size_t m_last;
+    bool m_has_last;
+    uint32_t m_allocations;
+    uint32_t m_fallbacks;
+};
+
+/**
+ * While alive, led_malloc and friends called from the task that created the
+ * scope take their memory from the hot and cold arenas instead of the heap.
+ * Open one around setup() so everything the LED pipeline keeps is packed in
+ * the arenas. Scopes do not nest.
+ */
+class ArenaScope {
+  public:
+    ArenaScope(void);
+    ~ArenaScope();
+};
+
+// Allocation entry points for the LED code, the heap outside an ArenaScope
+void *led_malloc(size_t size, MemoryRegion region = MEMORY_COLD);
+void *led_calloc(size_t count, size_t size, MemoryRegion region = MEMORY_COLD);
+void *led_realloc(void *ptr, size_t size, MemoryRegion region = MEMORY_COLD);
+void led_free(void *ptr);
+
+// Print the arena usage and the free heap
+void led_memory_report(void);
+
+// Class level operator new and delete going through led_malloc
+#define LED_ARENA_ALLOCATED                                                    \
+    static void *operator new(size_t size) { return led_malloc(size); }        \
+    static void operator delete(void *ptr) { led_free(ptr); }
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef __BYTE_ORDER_H__
+#define __BYTE_ORDER_H__
+
+#include <stdint.h>
+
+// Big endian fields of the input packets
+static inline uint16_t get_be16(const uint8_t *data) {
+    return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+static inline uint32_t get_be32(const uint8_t *data) {
+    return ((uint32_t)get_be16(data) << 16) | get_be16(data + 2);
+}
+
+static inline void put_be16(uint8_t *data, uint16_t value) {
+    data[0] = (uint8_t)(value >> 8);
+    data[1] = (uint8_t)value;
+}
+
+static inline void put_be32(uint8_t *data, uint32_t value) {
+    put_be16(data, (uint16_t)(value >> 16));
+    put_be16(data + 2, (uint16_t)value);
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef __COLOR_KERNELS_H__
+#define __COLOR_KERNELS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "palette.h"
+
+/**
+ * Kernels over whole spans of colors. Pixels are handled as packed words with
+ * the SWAR operations of color_swar.h, all four channels at once and without
+ * divisions. Results are written in place to colors, count pixels each.
+ */
+
+// colors * scale / 255
+void color_scale(Color *colors, size_t count, uint8_t scale);
+// colors + other, clamped to 255
+void color_add(Color *colors, const Color *other, size_t count);
+void color_add(Color *colors, size_t count, const Color &color);
+// colors - other, clamped to 0
+void color_sub(Color *colors, const Color *other, size_t count);
+void color_sub(Color *colors, size_t count, const Color &color);
+// colors * color / 255 per channel
+void color_multiply(Color *colors, size_t count, const Color &color);
+// Move colors amount / 255 of the way toward target
+void color_fade(Color *colors, size_t count, const Color &target,
+                uint8_t amount);
+// from + (to - from) * amount / 255
+void color_lerp(Color *colors, const Color *from, const Color *to,
+                size_t count, uint8_t amount);
+
+static inline void color_scale(Span<Color> colors, uint8_t scale) {
+    color_scale(colors.data(), colors.count(), scale);
+}
+static inline void color_add(Span<Color> colors, Span<const Color> other) {
+    color_add(colors.data(), other.data(),
+              colors.count() < other.count() ? colors.count() : other.count());
+}
+static inline void color_sub(Span<Color> colors, Span<const Color> other) {
+    color_sub(colors.data(), other.data(),
+              colors.count() < other.count() ? colors.count() : other.count());
+}
+static inline void color_multiply(Span<Color> colors, const Color &color) {
+    color_multiply(colors.data(), colors.count(), color);
+}
+static inline void color_fade(Span<Color> colors, const Color &target,
+                              uint8_t amount) {
+    color_fade(colors.data(), colors.count(), target, amount);
+}
+
+#endif
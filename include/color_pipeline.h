@@ -0,0 +1,72 @@
+#ifndef __COLOR_PIPELINE_H__
+#define __COLOR_PIPELINE_H__
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "palette.h"
+
+/**
+ * Output stage of a strip: brightness, gamma and white point folded into one
+ * 256 entry table per channel. Settings may change from any task, the tables
+ * are only rebuilt by the next apply() after a change so the pixels pay one
+ * lookup no matter how many settings are in use.
+ */
+class ColorPipeline {
+  public:
+    // Channel of a byte in the pixel layout given to apply()
+    static const uint8_t CHANNEL_RED = 0;
+    static const uint8_t CHANNEL_GREEN = 1;
+    static const uint8_t CHANNEL_BLUE = 2;
+    static const uint8_t CHANNEL_WHITE = 3;
+
+    ColorPipeline();
+
+    void setBrightness(uint8_t brightness);
+    uint8_t getBrightness(void) const { return m_brightness; }
+    // Exponent of the output curve, 1 keeps values linear
+    void setGamma(float gamma);
+    float getGamma(void) const { return m_gamma; }
+    // Scale of the red, green and blue channels so full white looks white
+    void setWhitePoint(const Color &white);
+    Color getWhitePoint(void) const { return m_white_point; }
+    // Spread the fraction lost when rounding to 8 bits over the next frames,
+    // the strip has to be redrawn every frame while enabled
+    void setDithering(bool enable);
+    bool getDithering(void) const { return m_dithering; }
+
+    // True when apply() would copy the bytes unchanged
+    bool isIdentity(void) const;
+    // Incremented on every change of the settings
+    uint32_t getGeneration(void) const { return m_generation.load(); }
+
+    /**
+     * Map len bytes of pixels from src into dst. Every pixel is stride bytes
+     * and channels[i] is the channel of its byte i. error holds the dithering
+     * remainder of every byte and must stay with the same pixels.
+     */
+    void apply(const uint8_t *src, uint8_t *dst, size_t len,
+               const uint8_t *channels, uint8_t stride, uint8_t *error);
+
+  private:
+    void changed(void);
+    void rebuild(void);
+
+    uint8_t m_brightness;
+    float m_gamma;
+    Color m_white_point;
+    bool m_dithering;
+    std::atomic<uint32_t> m_generation;
+
+    // Only touched by apply()
+    uint32_t m_built_generation;
+    float m_built_gamma;
+    // Gamma curve in 8.8 fixed point
+    uint16_t m_curve[256];
+    // Output of every channel in 8.8 fixed point and rounded to 8 bits
+    uint16_t m_fine[4][256];
+    uint8_t m_table[4][256];
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef __COMPOSITOR_H__
+#define __COMPOSITOR_H__
+
+#include "effects.h"
+
+// How a layer is combined with the layers below it
+enum BlendMode {
+    // Channels add up, clamped to full brightness
+    BLEND_ADD,
+    // Darkens the layers below, a white layer keeps them unchanged
+    BLEND_MULTIPLY,
+    // Inverse of multiply, lightens the layers below
+    BLEND_SCREEN,
+    // Brightest channel wins
+    BLEND_MAX,
+    // Drawn over the layers below, black pixels are transparent
+    BLEND_ALPHA,
+};
+
+/**
+ * Strip an effect renders into for a Compositor. The layer owns the effect
+ * and the Compositor owning the layer updates it. The pixels of the layer
+ * are the frame buffer of its effect, so effects rendering their buffer to
+ * the layer cost no copy.
+ */
+class LedLayer : public ILedStrip {
+  public:
+    LedLayer(uint16_t num_pixels, BlendMode mode, uint8_t opacity);
+    ~LedLayer();
+
+    void setEffect(EffectBase *effect);
+    EffectBase *getEffect(void) { return m_effect; }
+    void setMode(BlendMode mode) { m_mode = mode; }
+    BlendMode getMode(void) const { return m_mode; }
+    // 0 hides the layer, 255 blends it in full
+    void setOpacity(uint8_t opacity) { m_opacity = opacity; }
+    uint8_t getOpacity(void) const { return m_opacity; }
+
+    // Empty until an effect is set
+    LedsSpan getPixels(void);
+
+    void updateSegment(LedsSpan leds, size_t start, size_t end);
+    void updatePixels(LedsSpan leds);
+    void updatePixel(uint16_t index, ::Color color);
+    uint16_t getNumPixels(void) { return m_num_pixels; }
+
+  private:
+    uint16_t m_num_pixels;
+    EffectBase *m_effect;
+    BlendMode m_mode;
+    uint8_t m_opacity;
+};
+
+/**
+ * Effect stacking the output of other effects. Every frame each layer renders
+ * its effect, then the layers are blended onto black in the order they were
+ * added, one pass per layer over packed colors.
+ *
+ *   LedLayer *layer = compositor->addLayer(BLEND_ADD);
+ *   layer->setEffect(new Sparks<uint8_t>(layer, palette));
+ */
+class Compositor : public EffectBase {
+  public:
+    Compositor(ILedStrip *led_strip, size_t max_layers = 4);
+    ~Compositor();
+
+    // New layer on top of the others, the effect is set on the layer
+    LedLayer *addLayer(BlendMode mode, uint8_t opacity = 255);
+    uint32_t getNumLayers(void) const { return m_layers.count(); }
+    LedLayer *getLayer(uint32_t index) { return m_layers[index]; }
+
+    // Every layer is stepped by dt_us, hidden layers too
+    void update(uint32_t dt_us);
+
+  private:
+    ArrayList<LedLayer *> m_layers;
+};
+
+#endif
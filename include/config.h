@@ -8,8 +8,35 @@
 #define STRIP_TYPE (NEO_RBG + NEO_KHZ800)
 #define STRIP_REFRESH_RATE 60
 #define STRIP_TASK_CORE 0
+// Suspend the strip task until the effects publish a changed frame
+#define STRIP_WAIT_FOR_FRAMES false
+// Output stage of the strip, see ColorPipeline
+#define STRIP_BRIGHTNESS 255
+#define STRIP_GAMMA 1.0f
+// Applies to every color, the palettes carry their own color correction
+#define STRIP_WHITE_POINT Color::WHITE
+#define STRIP_DITHERING false
 
 #define EFFECTS_REFRESH_RATE 60
 #define EFFECTS_TASK_CORE 1
+// Render tasks helping the effects task on the other core, only made for
+// strips of two EFFECTS_RENDER_CHUNK or more. Off until a measurement on the
+// board shows a gain, on the host a worker slows 4000 pixels down.
+#define EFFECTS_RENDER_WORKERS 0
+#define EFFECTS_WORKERS_CORE 0
+
+// Serial is the native USB CDC port (ARDUINO_USB_CDC_ON_BOOT in
+// platformio.ini), which runs at full USB speed whatever the baud rate.
+// Builds without it use UART0 behind the USB to UART bridge, where 2 Mbaud
+// carries about 200 KB/s, 16 frames per second of 4000 pixels.
+#define SERIAL_BAUD 2000000
+// Bytes the serial port buffers while the serial input is busy
+#define SERIAL_RX_BUFFER_SIZE 8192
+// Pixel packets from a host on the serial port, see SerialInput
+#define SERIAL_INPUT_TASK_CORE 0
+
+// The strip deadlines trail the effects ones by this many microseconds, so a
+// frame is sent right after it was rendered
+#define STRIP_PHASE_US 4000
 
 #endif
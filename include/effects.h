@@ -1,35 +1,100 @@
 #ifndef __EFFECTS_H__
 #define __EFFECTS_H__
 
+#include <limits>
+
+#include "fixed.h"
+#include "heat_field.h"
 #include "led_controller.h"
 #include "palette.h"
+#include "random.h"
 #include "utils.h"
 
+// Settings given per tick move the effects that much every EFFECT_TICK_US,
+// one frame at 60 fps, whatever rate they are rendered at
+#define EFFECT_TICK_US 16667
+// Longer steps, e.g. for an effect that was not rendered for a while, are
+// cut to this. Every effect has settled into its animation by then.
+#define EFFECT_MAX_STEP_US 10000000
+// Split effects are rendered in jobs of about this many pixels when the
+// manager has workers, shorter effects are rendered in one job
+#ifndef EFFECTS_RENDER_CHUNK
+#define EFFECTS_RENDER_CHUNK 512
+#endif
+
 class EffectBase {
     // Simulator Base Class
   public:
     EffectBase(ILedStrip *led_strip, const Palette &palette)
         : m_pixels_ptr(led_strip), m_palette(palette),
-          m_leds(m_pixels_ptr->getNumPixels()) {}
+          m_leds(m_pixels_ptr->getNumPixels(), MEMORY_HOT) {}
+    virtual ~EffectBase() {}
+    LED_ARENA_ALLOCATED
 
-    // Update simulation
-    virtual void update(void);
+    // Advance the simulation by dt_us microseconds and render the frame
+    virtual void update(uint32_t dt_us);
+    // Split effects render every pixel on its own, so update() is also
+    // step() then render() over disjoint ranges, which may run on several
+    // tasks at once. Other effects only implement update().
+    virtual bool isSplit(void) const { return false; }
+    virtual void step(uint32_t dt_us) { (void)dt_us; }
+    // Render pixels first to last - 1 of the current state to the strip
+    virtual void render(uint16_t first, uint16_t last);
+    uint16_t getNumPixels(void) const { return m_leds.count(); }
+    // Frame rendered last, as handed to the strip
+    LedsList &getPixels(void) { return m_leds; }
+    // Hand the rendered frame over to the strip task
+    void publish(void) { m_pixels_ptr->publish(); }
+    // Restart the random sequence, effects with the same seed and settings
+    // render the same frames
+    void setSeed(uint32_t seed) { m_random.setSeed(seed); }
 
   private:
     ILedStrip *m_pixels_ptr;
 
   protected:
+    // dt_us in ticks, rounded to the nearest 1 / 65536 tick
+    static Q16_16 toTicks(uint32_t dt_us);
+    // Change over ticks of a rate given per tick, in the range of heat
+    static Q48_16 overTicks(Q16_16 rate, Q16_16 ticks) {
+        return Q48_16::fromRaw((int64_t)rate.raw() * ticks.raw() /
+                               Q16_16::one());
+    }
+
     Palette m_palette;
     LedsList m_leds;
+    Random m_random;
 };
 
+/**
+ * Renders all effects once per frame. With workers the frame is cut into
+ * jobs shared out between the manager task and the worker tasks, each one
+ * taking the next job not rendered yet, and the frame is only published once
+ * all of them are done. Split effects are stepped on the manager task and
+ * their pixels rendered in jobs of EFFECTS_RENDER_CHUNK pixels, the other
+ * effects are one job each. Frames under two chunks or of a single job are
+ * rendered by the manager task alone, waking the workers would cost more
+ * than it saves.
+ * Effects rendered in parallel must write disjoint pixels.
+ *
+ * Each effect is stepped by the time since it was last rendered, measured
+ * between frame deadlines when run by the task. Frames dropped under load and
+ * effects skipped for a while catch up on the next frame they render.
+ */
 class EffectsManager : public ITaskManager {
   public:
     EffectsManager(uint32_t num_of_effects, uint32_t refresh_rate = 60,
                    BaseType_t core = 1);
     ~EffectsManager();
 
-    void AddEffect(EffectBase *effect);
+    // Takes ownership of effect, false if the lists could not grow and the
+    // caller still owns it
+    bool AddEffect(EffectBase *effect);
+    // Render tasks helping the manager task, takes effect on the next start()
+    void setWorkers(uint32_t count, BaseType_t core = 0) {
+        m_num_workers = count;
+        m_workers_core = core;
+    }
 
     void setup(void);
     void update(void);
@@ -37,9 +102,49 @@ class EffectsManager : public ITaskManager {
 
     uint32_t count(void) {return m_effects.count();}
   protected:
+    struct RenderWorker {
+        EffectsManager *manager;
+        SemaphoreHandle_t start;
+        SemaphoreHandle_t done;
+        TaskHandle_t task;
+    };
+    struct RenderJob {
+        uint32_t index;
+        // Pixels of a split effect stepped already, both 0 to update() the
+        // whole effect
+        uint16_t first;
+        uint16_t last;
+    };
+
+    static void RenderWorkerTask(void *ctx);
+    // Render effects first to last - 1 as one frame and publish them
+    void renderFrame(uint32_t first, uint32_t last);
+    // Render jobs until none is left for this frame
+    void renderJobs(void);
+    // Start a frame due at the deadline of the task, or now when update()
+    // is called directly
+    void beginFrame(void);
+    // Time to step effect index by for the frame started last
+    uint32_t frameStep(uint32_t index);
+    // Render effect index for the frame started last
+    void renderEffect(uint32_t index);
+
     ArrayList<EffectBase *> m_effects;
+    // Frame time each effect was last rendered at, -1 before the first one
+    ArrayList<int64_t> m_rendered_at;
+    int64_t m_frame_us;
+    ArrayList<RenderWorker> m_workers;
+    uint32_t m_num_workers;
+    BaseType_t m_workers_core;
+    bool m_workers_stop;
+    ArrayList<RenderJob> m_jobs;
+    std::atomic<uint32_t> m_next_job;
 };
 
+/**
+ * Renders only the active effect. The others are skipped and resume where the
+ * time they missed has taken them once active again.
+ */
 class EffectManager : public EffectsManager {
   public:
     EffectManager(uint32_t refresh_rate = 60, BaseType_t core = 1);
@@ -51,76 +156,145 @@ class EffectManager : public EffectsManager {
     uint32_t m_active;
 };
 
-class HeatBase : public EffectBase {
+/**
+ * Effect rendering a field of heat values through the palette. T is the
+ * unsigned type storing one heat value, uint8_t is enough for palettes up to
+ * 256 colors and keeps the field at one byte per pixel. The heat effects are
+ * instantiated for uint8_t, uint16_t and uint32_t.
+ *
+ * Every heat value stays within [min, max], the setters clamp the field and
+ * the steps only write values in range, so rendering only reads the field.
+ * 8 bit heat renders through a table holding the color of every value, one
+ * load per pixel.
+ */
+template <typename T> class HeatBase : public EffectBase {
   public:
-    HeatBase(ILedStrip *pixels, const Palette &palette)
-        : EffectBase(pixels, palette), m_heat(m_leds.count()) {}
-    // Max heat value
-    void setMinHeat(uint32_t val) { m_min_heat = val; }
+    // Largest heat value, what T can store up to INT32_MAX so every heat
+    // value is an int32_t and a Q48_16. Higher values are clamped to it.
+    static constexpr T HEAT_LIMIT =
+        std::numeric_limits<T>::max() < INT32_MAX
+            ? std::numeric_limits<T>::max()
+            : (T)INT32_MAX;
+
+    HeatBase(ILedStrip *pixels, const Palette &palette);
     // Min heat value
-    void setMaxHeat(uint32_t val) { m_max_heat = val; }
+    void setMinHeat(uint32_t val) {
+        m_min_heat = clampHeat(val);
+        limitField();
+    }
+    // Max heat value
+    void setMaxHeat(uint32_t val) {
+        m_max_heat = clampHeat(val);
+        limitField();
+    }
 
-    void update(void);
+    // Steps the heat field, then renders all of it
+    void update(uint32_t dt_us);
+    bool isSplit(void) const { return true; }
+    // Heat of pixels first to last - 1 through the palette to the strip
+    void render(uint16_t first, uint16_t last);
 
   protected:
-    uint32_t m_min_heat = 0;
-    uint32_t m_max_heat = 0;
-    ArrayList<uint32_t> m_heat;
+    static T clampHeat(int64_t value) {
+        return value < 0 ? 0 : value > HEAT_LIMIT ? HEAT_LIMIT : (T)value;
+    }
+    // value clamped to [min, max]
+    T limitHeat(int64_t value) const {
+        return value < m_min_heat   ? m_min_heat
+               : value > m_max_heat ? m_max_heat
+                                    : (T)value;
+    }
+    // Bring every heat value into [min, max]
+    void limitField(void);
+
+    T m_min_heat = 0;
+    T m_max_heat = 0;
+    HeatField<T> m_heat;
+    // Color of every heat value for 8 bit heat, empty for wider types
+    LedsList m_colors;
 };
 
-class Sparks : public HeatBase {
+template <typename T> class Sparks : public HeatBase<T> {
   public:
-    using HeatBase::HeatBase;
+    using HeatBase<T>::HeatBase;
     // How much to cold down per tick
-    void setColdDown(float val) { m_cold_down = val; }
+    void setColdDown(float val) { m_cold_down = Q16_16::fromFloat(val); }
+    void setColdDown(Q16_16 val) { m_cold_down = val; }
     // Number of Sparks to ignite per tick
-    void setNumOfSparks(float val) { m_num_of_sparks = val; }
+    void setNumOfSparks(float val) {
+        m_num_of_sparks = Q16_16::fromFloat(val);
+    }
+    void setNumOfSparks(Q16_16 val) { m_num_of_sparks = val; }
     // Initial spark value
-    void setSparkValue(float val) { m_spark_value = val; }
+    void setSparkValue(float val) { m_spark_value = Q48_16::fromFloat(val); }
+    void setSparkValue(Q16_16 val) { m_spark_value = Q48_16::from(val); }
 
-    void update(void);
+    void step(uint32_t dt_us);
 
   protected:
-    float m_cold_down = 0;
-    float m_num_of_sparks = 0;
-    float m_spark_value = 0;
+    Q16_16 m_cold_down;
+    Q16_16 m_num_of_sparks;
+    Q48_16 m_spark_value;
 
-    float m_cold_down_val = 0;
-    float m_sparks_val = 0;
+    Q16_16 m_cold_down_val;
+    Q16_16 m_sparks_val;
 };
 
-class Roll : public HeatBase {
+template <typename T> class Roll : public HeatBase<T> {
   public:
-    using HeatBase::HeatBase;
+    using HeatBase<T>::HeatBase;
 
-    void update(void);
+    void step(uint32_t dt_us);
 
-    // Set how fast change the color
-    void setSpeed(float value) { m_heat_speed = value; }
+    // Set how fast change the color per tick, the heat wraps around from
+    // max to min
+    void setSpeed(float value) { m_heat_speed = Q16_16::fromFloat(value); }
+    void setSpeed(Q16_16 value) { m_heat_speed = value; }
 
-    // Set how fast move shift the color
-    void setRollSpeed(float value) { m_roll_speed = value; }
+    // Set how many pixels per tick the colors move
+    void setRollSpeed(float value) {
+        m_roll_speed = Q16_16::fromFloat(value);
+    }
+    void setRollSpeed(Q16_16 value) { m_roll_speed = value; }
 
   protected:
-    float m_heat_speed = 0;
-    float m_roll_speed = 0;
+    // Heat wrapped into [min, max + 1), every heat value is shown as long
+    Q48_16 wrapHeat(Q48_16 heat) const;
 
-    float m_heat_count = 0;
-    float m_roll_count = 0;
+    Q16_16 m_heat_speed;
+    Q16_16 m_roll_speed;
+
+    Q48_16 m_heat_count;
+    Q16_16 m_roll_count;
 };
 
-class Pulses : public HeatBase {
+template <typename T> class Pulses : public HeatBase<T> {
   public:
-    using HeatBase::HeatBase;
+    using HeatBase<T>::HeatBase;
 
-    void update(void);
+    void step(uint32_t dt_us);
 
-    void setSpeed(float value) { m_speed = value; }
+    // Heat change per tick, the heat bounces between min and max
+    void setSpeed(float value) { m_speed = Q16_16::fromFloat(value); }
+    void setSpeed(Q16_16 value) { m_speed = value; }
 
   protected:
-    float m_speed = 0;
-    float m_current = 0;
-    float m_direction = 0;
+    Q16_16 m_speed;
+    Q48_16 m_current;
+    int8_t m_direction = 0;
 };
 
+extern template class HeatBase<uint8_t>;
+extern template class HeatBase<uint16_t>;
+extern template class HeatBase<uint32_t>;
+extern template class Sparks<uint8_t>;
+extern template class Sparks<uint16_t>;
+extern template class Sparks<uint32_t>;
+extern template class Roll<uint8_t>;
+extern template class Roll<uint16_t>;
+extern template class Roll<uint32_t>;
+extern template class Pulses<uint8_t>;
+extern template class Pulses<uint16_t>;
+extern template class Pulses<uint32_t>;
+
 #endif
\ No newline at end of file
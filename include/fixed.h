@@ -0,0 +1,98 @@
+#ifndef __FIXED_H__
+#define __FIXED_H__
+
+#include <stdint.h>
+
+/**
+ * Signed fixed point number with FRAC fractional bits stored in T. W must be
+ * wide enough to hold the product of two raw values. All operations are plain
+ * integer math so results are the same on every build and target.
+ */
+template <typename T, typename W, int FRAC> class Fixed {
+  public:
+    Fixed() : m_raw(0) {}
+
+    static constexpr T one(void) { return (T)((T)1 << FRAC); }
+
+    static Fixed fromRaw(T raw) {
+        Fixed value;
+        value.m_raw = raw;
+        return value;
+    }
+    static Fixed fromInt(int32_t value) { return fromRaw((T)(value * one())); }
+    // Rounds to the nearest representable value
+    static Fixed fromFloat(float value) {
+        return fromRaw((T)(value * one() + (value < 0 ? -0.5f : 0.5f)));
+    }
+    // num / den without going through float
+    static Fixed fromRatio(int32_t num, int32_t den) {
+        return fromRaw((T)(((W)num * one()) / den));
+    }
+    // Same value from a type with the same fractional bits, exact as long as
+    // T holds it
+    template <typename U, typename V>
+    static Fixed from(const Fixed<U, V, FRAC> &other) {
+        return fromRaw((T)other.raw());
+    }
+
+    T raw(void) const { return m_raw; }
+    // Truncates toward zero, same as casting a float to an integer
+    int32_t toInt(void) const {
+        return m_raw < 0 ? -(int32_t)(-m_raw >> FRAC) : (int32_t)(m_raw >> FRAC);
+    }
+    float toFloat(void) const { return (float)m_raw / one(); }
+
+    Fixed operator+(const Fixed &other) const {
+        return fromRaw(m_raw + other.m_raw);
+    }
+    Fixed operator-(const Fixed &other) const {
+        return fromRaw(m_raw - other.m_raw);
+    }
+    Fixed operator-(void) const { return fromRaw(-m_raw); }
+    Fixed operator*(const Fixed &other) const {
+        return fromRaw((T)(((W)m_raw * other.m_raw) / one()));
+    }
+    Fixed operator*(int32_t value) const { return fromRaw(m_raw * value); }
+    Fixed operator/(const Fixed &other) const {
+        return fromRaw((T)(((W)m_raw * one()) / other.m_raw));
+    }
+    Fixed &operator+=(const Fixed &other) {
+        m_raw += other.m_raw;
+        return *this;
+    }
+    Fixed &operator-=(const Fixed &other) {
+        m_raw -= other.m_raw;
+        return *this;
+    }
+
+    bool operator==(const Fixed &other) const { return m_raw == other.m_raw; }
+    bool operator!=(const Fixed &other) const { return m_raw != other.m_raw; }
+    bool operator<(const Fixed &other) const { return m_raw < other.m_raw; }
+    bool operator<=(const Fixed &other) const { return m_raw <= other.m_raw; }
+    bool operator>(const Fixed &other) const { return m_raw > other.m_raw; }
+    bool operator>=(const Fixed &other) const { return m_raw >= other.m_raw; }
+
+  private:
+    T m_raw;
+};
+
+// Accumulators and rates, integer range +-32767
+typedef Fixed<int32_t, int64_t, 16> Q16_16;
+// Small factors, integer range +-127
+typedef Fixed<int16_t, int32_t, 8> Q8_8;
+// Heat values and positions, integer range of int32_t. Only add, subtract
+// and compare, products of two raw values do not fit.
+typedef Fixed<int64_t, int64_t, 16> Q48_16;
+
+/**
+ * Interpolate between a and b at pos / span, rounded down. The result is the
+ * exact rational value so no rounding error accumulates.
+ */
+constexpr static inline uint8_t lerp_u8(uint8_t a, uint8_t b, uint32_t pos,
+                                        uint32_t span) {
+    int32_t value = (int32_t)a * (int32_t)span +
+                    ((int32_t)b - (int32_t)a) * (int32_t)pos;
+    return (uint8_t)(value / (int32_t)span);
+}
+
+#endif
@@ -0,0 +1,231 @@
+#ifndef __FRAME_RECORDING_H__
+#define __FRAME_RECORDING_H__
+
+#include <stdio.h>
+
+#include "effects.h"
+
+/**
+ * Recording format, all numbers little endian:
+ *
+ *   header   "LEDR", version, channels, pixels (2), frame rate (2),
+ *            keyframe interval (2), 4 reserved bytes
+ *   frame    type (1), payload length (4), payload
+ *
+ * A frame is stored as R, G, B bytes per pixel, followed by W for 4 channel
+ * recordings. The payload is the frame XORed with the previous one, run
+ * length coded in tokens: 0x00-0x7f skips token + 1 unchanged bytes,
+ * 0x80-0xff is followed by token - 0x7f bytes to XOR in. Keyframes are coded
+ * against a black frame so playback can start from them.
+ */
+#define RECORDING_MAGIC "LEDR"
+#define RECORDING_VERSION 1
+#define RECORDING_HEADER_SIZE 16
+#define RECORDING_FRAME_HEADER_SIZE 5
+#define RECORDING_KEYFRAME 0
+#define RECORDING_DELTA 1
+
+struct RecordingInfo {
+    // 3 for RGB, 4 to keep the white channel
+    uint8_t channels;
+    uint16_t num_pixels;
+    uint16_t frame_rate;
+    // Every n-th frame is a keyframe, 0 for the first frame only
+    uint16_t keyframe_interval;
+};
+
+// Where recorded bytes go
+class IFrameSink {
+  public:
+    virtual ~IFrameSink() {}
+    virtual bool write(const uint8_t *data, size_t len) = 0;
+};
+
+// Where recorded bytes come from, rewind() goes back to the first byte
+class IFrameSource {
+  public:
+    virtual ~IFrameSource() {}
+    // Bytes read, less than len at the end of the recording
+    virtual size_t read(uint8_t *data, size_t len) = 0;
+    virtual bool rewind(void) = 0;
+};
+
+/**
+ * Recording read in place, from a const array in flash or a file mapped in
+ * memory on the host. The data must outlive the source.
+ */
+class MemoryFrameSource : public IFrameSource {
+  public:
+    MemoryFrameSource(const uint8_t *data, size_t size)
+        : m_data(data), m_size(size), m_pos(0) {}
+
+    size_t read(uint8_t *data, size_t len);
+    bool rewind(void) {
+        m_pos = 0;
+        return true;
+    }
+
+  private:
+    const uint8_t *m_data;
+    size_t m_size;
+    size_t m_pos;
+};
+
+/**
+ * stdio file, on the ESP32 files on LittleFS are opened through its VFS
+ * mount point, e.g. fopen("/littlefs/fire.ledr", "rb"). The file is closed
+ * with the source or sink.
+ */
+class FileFrameSource : public IFrameSource {
+  public:
+    FileFrameSource(FILE *file) : m_file(file) {}
+    ~FileFrameSource();
+
+    size_t read(uint8_t *data, size_t len);
+    bool rewind(void);
+
+  private:
+    FILE *m_file;
+};
+
+class FileFrameSink : public IFrameSink {
+  public:
+    FileFrameSink(FILE *file) : m_file(file) {}
+    ~FileFrameSink();
+
+    bool write(const uint8_t *data, size_t len);
+
+  private:
+    FILE *m_file;
+};
+
+/**
+ * Codes frames into the recording format. The scratch buffer for one frame
+ * and the previous frame are allocated once.
+ */
+class FrameEncoder {
+  public:
+    FrameEncoder(IFrameSink *sink, const RecordingInfo &info);
+
+    // Writes the header before the first frame, false if the sink failed
+    bool addFrame(LedsSpan frame);
+    uint32_t getFrameCount(void) const { return m_frames; }
+    // Bytes written so far, header included
+    uint32_t getSize(void) const { return m_size; }
+
+  private:
+    bool writeHeader(void);
+
+    IFrameSink *m_sink;
+    RecordingInfo m_info;
+    // Frames as stored, the pixels of the last frame not in the span given
+    // to addFrame() keep their value
+    ArrayList<uint8_t> m_current;
+    ArrayList<uint8_t> m_previous;
+    ArrayList<uint8_t> m_payload;
+    uint32_t m_frames;
+    uint32_t m_size;
+};
+
+/**
+ * Decodes a recording frame by frame into its own buffer, or into a frame
+ * given with setOutput() while writing the pixels that change to a strip.
+ */
+class FrameDecoder {
+  public:
+    FrameDecoder(IFrameSource *source);
+
+    // Reads the header, false if the source is not a recording
+    bool begin(void);
+    const RecordingInfo &getInfo(void) const { return m_info; }
+    // Decode the next frame, false at the end of the recording or on a
+    // corrupt frame
+    bool nextFrame(void);
+    // Start again from the first frame
+    bool rewind(void);
+    LedsSpan getFrame(void) const { return m_output; }
+    // Decode into frame, pixels past its end are dropped. Each run of
+    // changed pixels is written to strip, if any, as soon as it is decoded
+    // and keyframes are written whole. Call before begin().
+    void setOutput(Span<::Color> frame, ILedStrip *strip);
+
+  private:
+    bool applyPayload(uint32_t len);
+    // Convert the pixels of len stored bytes from pos to colors
+    void unpack(size_t pos, size_t len);
+
+    IFrameSource *m_source;
+    RecordingInfo m_info;
+    // Frame as stored, unpacked into m_output once decoded
+    ArrayList<uint8_t> m_data;
+    // Own frame when no output is set
+    LedsList m_frame;
+    Span<::Color> m_output;
+    ILedStrip *m_strip;
+    // Keyframe being decoded, written to the strip at once when done
+    bool m_keyframe;
+    uint8_t m_buffer[256];
+};
+
+/**
+ * Strip recording the frames effects render into it. Effects update it like
+ * any other strip and recordFrame() appends the current frame, call it once
+ * per EffectsManager::update().
+ *
+ *   FrameRecorder recorder(new FileFrameSink(file), 250, 60);
+ *   manager.AddEffect(new Sparks<uint8_t>(&recorder, palettes::WHITE));
+ */
+class FrameRecorder : public ILedStrip {
+  public:
+    // Takes ownership of sink
+    FrameRecorder(IFrameSink *sink, uint16_t num_pixels, uint16_t frame_rate,
+                  uint16_t keyframe_interval = 0, uint8_t channels = 3);
+    ~FrameRecorder();
+
+    bool recordFrame(void) { return m_encoder.addFrame(m_frame); }
+    const FrameEncoder &getEncoder(void) const { return m_encoder; }
+
+    void updateSegment(LedsSpan leds, size_t start, size_t end);
+    void updatePixels(LedsSpan leds);
+    void updatePixel(uint16_t index, ::Color color);
+    uint16_t getNumPixels(void) { return m_frame.count(); }
+
+  private:
+    IFrameSink *m_sink;
+    LedsList m_frame;
+    FrameEncoder m_encoder;
+};
+
+/**
+ * Effect playing a recording at its own frame rate, independent of the
+ * refresh rate of the effects task, and looping at the end. The recording
+ * advances by the time given to update(). Decoding only touches the bytes
+ * that changed and only the pixels they belong to are written to the strip,
+ * so playing costs far less than rendering.
+ */
+class PlaybackEffect : public EffectBase {
+  public:
+    // Takes ownership of source
+    PlaybackEffect(ILedStrip *led_strip, IFrameSource *source);
+    ~PlaybackEffect();
+
+    // False if the source is not a valid recording, nothing is played then
+    bool isValid(void) const { return m_valid; }
+    void setLoop(bool loop) { m_loop = loop; }
+    uint32_t getPlayedFrames(void) const { return m_played_frames; }
+
+    void update(uint32_t dt_us);
+
+  private:
+    IFrameSource *m_source;
+    FrameDecoder m_decoder;
+    bool m_valid;
+    bool m_loop;
+    uint32_t m_frame_interval_us;
+    // Playing time and the time the next frame is due
+    uint32_t m_time_us;
+    uint32_t m_next_frame_us;
+    uint32_t m_played_frames;
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef __HEAT_FIELD_H__
+#define __HEAT_FIELD_H__
+
+#include "utils.h"
+
+/**
+ * Ring buffer of heat values with a moving origin. Cell i is stored at
+ * (origin + i) % count, so scrolling only moves the origin and writes the
+ * cells that enter the field. Reading in order is done in two runs, head()
+ * then tail(). T is the unsigned type of a cell, instantiated for uint8_t,
+ * uint16_t and uint32_t.
+ */
+template <typename T> class HeatField {
+  public:
+    HeatField(size_t count, MemoryRegion region = MEMORY_HOT)
+        : m_cells(count, region), m_origin(0) {}
+
+    size_t count(void) const { return m_cells.count(); }
+
+    T &operator[](size_t index) { return m_cells[wrap(index)]; }
+    T operator[](size_t index) const { return m_cells[wrap(index)]; }
+
+    // Cells from index 0 up to the end of the storage
+    Span<T> head(void) {
+        return Span<T>(m_cells.data() + m_origin, m_cells.count() - m_origin);
+    }
+    // Cells after head(), wrapped around to the start of the storage
+    Span<T> tail(void) { return Span<T>(m_cells.data(), m_origin); }
+    // Every cell in storage order, for updates that do not depend on the
+    // position of the cell
+    Span<T> cells(void) { return m_cells; }
+    // Cells first up to last in order, the part stored in head() then the
+    // part in tail()
+    void range(size_t first, size_t last, Span<T> &head_part,
+               Span<T> &tail_part) {
+        size_t split = m_cells.count() - m_origin;
+        head_part = head().subspan(first, last - first);
+        first = first > split ? first - split : 0;
+        last = last > split ? last - split : 0;
+        tail_part = tail().subspan(first, last - first);
+    }
+
+    void fill(T value);
+    // Move every cell steps places toward the end, negative steps toward
+    // the start. The cells scrolled in are set to value.
+    void scroll(int32_t steps, T value);
+
+  private:
+    size_t wrap(size_t index) const {
+        index += m_origin;
+        return index < m_cells.count() ? index : index - m_cells.count();
+    }
+
+    ArrayList<T> m_cells;
+    size_t m_origin;
+};
+
+extern template class HeatField<uint8_t>;
+extern template class HeatField<uint16_t>;
+extern template class HeatField<uint32_t>;
+
+#endif
@@ -2,34 +2,103 @@
 #define __LED_CONTROLLER_H__
 
 #include <Adafruit_NeoPixel.h>
+#include <atomic>
 #include <memory>
+#include <semphr.h>
 #include <task.h>
 
+#include "color_pipeline.h"
+#include "led_output.h"
 #include "palette.h"
+#include "pixel_encoder.h"
+#include "pixel_map.h"
 #include "utils.h"
 
 typedef ArrayList<::Color> LedsList;
+// Colors handed to a strip, LedsList and InlineArrayList convert to it
+typedef Span<const ::Color> LedsSpan;
 
 class ILedStrip {
   public:
-    virtual void updateSegment(const LedsList &leds, size_t start,
-                               size_t end) = 0;
-    virtual void updatePixels(const LedsList &pixels) = 0;
+    virtual ~ILedStrip() {}
+    LED_ARENA_ALLOCATED
+
+    virtual void updateSegment(LedsSpan leds, size_t start, size_t end) = 0;
+    virtual void updatePixels(LedsSpan pixels) = 0;
     virtual void updatePixel(uint16_t index, ::Color color) = 0;
     virtual uint16_t getNumPixels(void) = 0;
+    // Make the pixels written so far visible to draw() as one frame
+    virtual void publish(void) {};
     virtual void draw(void) {};
 };
 
+/**
+ * The effects task writes into the back frame and publish() swaps it with the
+ * shared frame, draw() takes the shared frame if a newer one was published.
+ * Neither side blocks and draw() only ever sees complete frames.
+ */
 class LedStrip : public Adafruit_NeoPixel, public ILedStrip {
   private:
+    static const uint32_t FRAME_INDEX_MASK = 0x03;
+    static const uint32_t FRAME_FRESH = 0x04;
+
     neoPixelType m_type;
-    uint8_t *m_buffer;
-    Mutex m_mutex;
+    // Encoders specialized for the color order of m_type, encodePixel is
+    // used for orders without one
+    PixelEncoder m_encoder;
+    uint8_t *m_frames[3];
+    // Producer side, m_pending is set when the back frame differs from the
+    // last published frame
+    uint32_t m_back;
+    // Frame last handed to draw(), keeps its content until the next publish
+    uint32_t m_last_published;
+    std::atomic<bool> m_pending;
+    SemaphoreHandle_t m_frame_signal;
+    // Index of the shared frame and FRAME_FRESH if not taken by draw() yet
+    std::atomic<uint32_t> m_shared;
+    // Consumer side
+    uint32_t m_front;
+    ILedOutput *m_output;
+    // Output stage, applied to the front frame into m_wire when not identity
+    ColorPipeline m_pipeline;
+    uint32_t m_drawn_generation;
+    uint8_t *m_wire;
+    uint8_t *m_dither_error;
+    uint8_t m_channels[4];
+    // Frame counters, published is written by the producer only
+    std::atomic<uint32_t> m_published_frames;
+    uint32_t m_drawn_frames;
+    uint32_t m_skipped_frames;
     ArrayList<ILedStrip *> m_segments;
 
+    // Returns non zero if the pixel changed
+    uint8_t encodePixel(uint8_t *buffer, uint16_t index,
+                        const ::Color &color) {
+        uint8_t *p = &(buffer[index * (hasWhite() ? 4 : 3)]);
+        uint8_t diff = (p[this->rOffset] ^ color.R()) |
+                       (p[this->gOffset] ^ color.G()) |
+                       (p[this->bOffset] ^ color.B());
+        p[this->rOffset] = color.R();
+        p[this->gOffset] = color.G();
+        p[this->bOffset] = color.B();
+        if (hasWhite()) {
+            diff |= p[this->wOffset] ^ color.W();
+            p[this->wOffset] = color.W();
+        }
+        return diff;
+    }
+    // Let a task waiting for frames redraw with new output settings
+    void wakeDraw(void);
+
   public:
     LedStrip(uint16_t n, int16_t pin, neoPixelType type);
-    LedStrip(void) : Adafruit_NeoPixel() {}
+    LedStrip(void)
+        : Adafruit_NeoPixel(), m_encoder{nullptr, nullptr, nullptr},
+          m_frames{nullptr, nullptr, nullptr}, m_back(0),
+          m_last_published(1), m_pending(false), m_frame_signal(nullptr),
+          m_shared(1), m_front(2), m_output(nullptr), m_drawn_generation(0),
+          m_wire(nullptr), m_dither_error(nullptr), m_published_frames(0),
+          m_drawn_frames(0), m_skipped_frames(0) {}
     LedStrip(const LedStrip &other)
         : LedStrip(other.numLEDs, other.pin, other.m_type) {}
     ~LedStrip();
@@ -41,31 +110,124 @@ class LedStrip : public Adafruit_NeoPixel, public ILedStrip {
     uint16_t getNumPixels(void) { return Adafruit_NeoPixel::numPixels(); }
     bool hasWhite(void) { return this->wOffset != this->rOffset; }
 
+    // Replace the output backend, the strip takes ownership of output
+    void setOutput(ILedOutput *output);
+    ILedOutput *getOutput(void) { return m_output; }
+    // True while the last drawn frame is still on the wire
+    bool isDrawing(void) { return m_output != nullptr && m_output->isBusy(); }
+    // Wait for the last drawn frame to be sent, false on timeout
+    bool waitDrawn(TickType_t ticks = portMAX_DELAY);
+
+    // True if a frame was published that draw() did not take yet
+    bool hasNewFrame(void) {
+        return m_shared.load(std::memory_order_relaxed) & FRAME_FRESH;
+    }
+    // True if draw() would send something, a new frame or the last one
+    // again because the output settings changed
+    bool needsDraw(void) {
+        return hasNewFrame() || m_pipeline.getDithering() ||
+               m_pipeline.getGeneration() != m_drawn_generation;
+    }
+
+    // Output settings, applied by draw() to every frame sent. Changing them
+    // redraws the last frame without the effects rendering a new one.
+    void setBrightness(uint8_t brightness);
+    uint8_t getBrightness(void) const { return m_pipeline.getBrightness(); }
+    void setGamma(float gamma);
+    void setWhitePoint(const ::Color &white);
+    // Needs draw() on every frame, so the strip task should not wait for
+    // frames while enabled
+    void setDithering(bool enable);
+    const ColorPipeline &getPipeline(void) const { return m_pipeline; }
+    // Binary semaphore given on every published frame, may be shared by
+    // several strips
+    void setFrameSignal(SemaphoreHandle_t signal) { m_frame_signal = signal; }
+    // Frames published, also works as the generation of the newest frame
+    uint32_t getPublishedFrames(void) { return m_published_frames.load(); }
+    uint32_t getDrawnFrames(void) { return m_drawn_frames; }
+    // draw() calls skipped because nothing changed
+    uint32_t getSkippedFrames(void) { return m_skipped_frames; }
+
     ILedStrip *GetSegment(uint32_t start, uint32_t stop);
+    // Segment laid out by map, nullptr if the map does not fit the strip
+    ILedStrip *GetSegment(const PixelMap &map);
     void ReleaseSegment(ILedStrip *segment);
 
-    void updateSegment(const LedsList &leds, size_t start, size_t end);
-    void updatePixels(const LedsList &leds);
+    void updateSegment(LedsSpan leds, size_t start, size_t end);
+    // Write leds[i - start] to pixel map[i] for i in [start, end)
+    void updateMapped(LedsSpan leds, size_t start, size_t end,
+                      const PixelMap &map);
+    // Same as updateSegment and updateMapped for a raw color array
+    void writePixels(const ::Color *colors, size_t start, size_t end);
+    void writeMapped(const ::Color *colors, size_t start, size_t end,
+                     const PixelMap &map);
+    // Write count pixels from start given as R, G, B bytes, e.g. straight
+    // from a network packet
+    void writeRgb(const uint8_t *rgb, size_t start, size_t count);
+    void updatePixels(LedsSpan leds);
     void updatePixel(uint16_t index, ::Color color);
+    // Hand the back frame to draw(), does nothing if no pixel changed
+    void publish(void);
+    // Drop the pixels written since the last publish(), e.g. a frame that
+    // failed its checksum
+    void discard(void);
+    // Start sending the newest published frame and return without waiting
+    // for the transfer, only waits if the previous one is still running.
+    // Does nothing if no new frame was published.
     void draw(void);
 };
 
+/**
+ * View on a part of a LedStrip, pixels are written straight into the strip's
+ * back frame through the segment's PixelMap.
+ */
 class LedStripSegment : public ILedStrip {
   public:
     LedStripSegment(LedStrip *led_strip, size_t start, size_t end)
-        : m_led_strip_ptr(led_strip), m_start(start), m_end(end),
-          m_leds(end - start) {}
+        : m_led_strip_ptr(led_strip),
+          m_map(PixelMap::linear(start, end - start)) {}
+    LedStripSegment(LedStrip *led_strip, const PixelMap &map)
+        : m_led_strip_ptr(led_strip), m_map(map) {}
 
-    void updateSegment(const LedsList &leds, size_t start, size_t end);
-    void updatePixels(const LedsList &leds);
+    void updateSegment(LedsSpan leds, size_t start, size_t end);
+    void updatePixels(LedsSpan leds);
     void updatePixel(uint16_t index, ::Color color);
-    uint16_t getNumPixels(void) { return m_end - m_start; }
+    uint16_t getNumPixels(void) { return m_map.count(); }
+    void publish(void) { m_led_strip_ptr->publish(); }
 
   protected:
     LedStrip *m_led_strip_ptr;
-    size_t m_start;
-    size_t m_end;
-    LedsList m_leds;
+    PixelMap m_map;
+};
+
+/**
+ * Several strips, possibly on different pins, presented to effects as one
+ * logical strip. Pixels are written straight into each strip's back frame.
+ */
+class LedCanvas : public ILedStrip {
+  public:
+    LedCanvas(size_t max_parts = 4);
+    ~LedCanvas();
+
+    // Append a whole strip to the end of the canvas
+    void addStrip(LedStrip *strip);
+    // Append the pixels of strip selected by map, false if map does not fit
+    bool addSegment(LedStrip *strip, const PixelMap &map);
+
+    void updateSegment(LedsSpan leds, size_t start, size_t end);
+    void updatePixels(LedsSpan leds);
+    void updatePixel(uint16_t index, ::Color color);
+    uint16_t getNumPixels(void) { return m_num_pixels; }
+    void publish(void);
+
+  private:
+    struct Part {
+        LedStrip *strip;
+        PixelMap *map;
+        size_t offset;
+    };
+    ArrayList<Part> m_parts;
+    uint16_t m_num_pixels;
 };
 
 /******************************************************************************
@@ -75,10 +237,17 @@ class LedStripManager : public LedStrip, public ITaskManager {
   public:
     LedStripManager(uint16_t n, int16_t pin, neoPixelType type,
                     uint32_t refresh_rate = 60, BaseType_t core = 0);
+    ~LedStripManager();
+
+    // Suspend the task until a new frame is published instead of polling
+    void setWaitForFrames(bool enable);
 
     void setup(void);
     void update(void);
     void cleanup(void);
+
+  private:
+    SemaphoreHandle_t m_frame_signal;
 };
 
 /******************************************************************************
@@ -93,6 +262,14 @@ class LedStripsManager : public ITaskManager {
     uint16_t addLedStrip(uint16_t number_of_leds, int16_t pind,
                          neoPixelType type);
     LedStrip *getLedStrip(uint16_t id);
+    // New canvas over all strips in the order they were added, owned by the
+    // caller
+    LedCanvas *createCanvas(void);
+
+    // Suspend the task until any strip publishes a new frame
+    void setWaitForFrames(bool enable);
+    // Same brightness on every strip
+    void setBrightness(uint8_t brightness);
 
     void setup(void);
     void update(void);
@@ -100,6 +277,7 @@ class LedStripsManager : public ITaskManager {
 
   private:
     ArrayList<LedStrip *> m_led_strips;
+    SemaphoreHandle_t m_frame_signal;
 };
 
 #endif
\ No newline at end of file
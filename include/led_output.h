@@ -0,0 +1,123 @@
+#ifndef __LED_OUTPUT_H__
+#define __LED_OUTPUT_H__
+
+#include <Adafruit_NeoPixel.h>
+#include <Arduino.h>
+#include <stdint.h>
+#include <task.h>
+
+#include "utils.h"
+
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 3
+#define LED_OUTPUT_HAS_RMT 1
+#endif
+
+// WS281x latch time between two frames
+#define LED_OUTPUT_LATCH_US 300
+
+typedef void (*LedOutputCallback)(void *ctx);
+
+/**
+ * Sends encoded frames to the strip. transmit() only starts the transfer, the
+ * data must stay untouched until isBusy() returns false. Backends without a
+ * completion interrupt report completion when they are polled.
+ */
+class ILedOutput {
+  public:
+    ILedOutput(void) : m_callback(nullptr), m_callback_ctx(nullptr) {}
+    virtual ~ILedOutput() {}
+
+    virtual bool transmit(const uint8_t *data, size_t len) = 0;
+    virtual bool isBusy(void) = 0;
+    // Block until the current transfer is done, false on timeout
+    virtual bool wait(TickType_t ticks) = 0;
+
+    // Called once every time a transfer completes
+    void onComplete(LedOutputCallback callback, void *ctx) {
+        m_callback = callback;
+        m_callback_ctx = ctx;
+    }
+
+  protected:
+    void notifyComplete(void) {
+        if (m_callback != nullptr) {
+            m_callback(m_callback_ctx);
+        }
+    }
+
+  private:
+    LedOutputCallback m_callback;
+    void *m_callback_ctx;
+};
+
+/**
+ * Blocking fallback through Adafruit_NeoPixel::show()
+ */
+class NeoPixelOutput : public ILedOutput {
+  public:
+    NeoPixelOutput(Adafruit_NeoPixel &strip) : m_strip(strip) {}
+
+    bool transmit(const uint8_t *data, size_t len);
+    bool isBusy(void) { return false; }
+    bool wait(TickType_t ticks) {
+        (void)ticks;
+        return true;
+    }
+
+  private:
+    Adafruit_NeoPixel &m_strip;
+};
+
+#ifdef LED_OUTPUT_HAS_RMT
+/**
+ * Non-blocking WS281x output on an RMT channel of the ESP32
+ */
+class RmtLedOutput : public ILedOutput {
+  public:
+    RmtLedOutput(int16_t pin, neoPixelType type);
+    ~RmtLedOutput();
+
+    bool transmit(const uint8_t *data, size_t len);
+    bool isBusy(void);
+    bool wait(TickType_t ticks);
+
+  private:
+    int16_t m_pin;
+    bool m_khz400;
+    bool m_initialized;
+    bool m_sending;
+    uint32_t m_done_us;
+    ArrayList<rmt_data_t> m_symbols;
+};
+#endif
+
+/**
+ * Host stand-in that only simulates the wire time of a WS281x transfer and
+ * keeps the last frame for inspection.
+ */
+class MockLedOutput : public ILedOutput {
+  public:
+    MockLedOutput(neoPixelType type = NEO_KHZ800);
+
+    bool transmit(const uint8_t *data, size_t len);
+    bool isBusy(void);
+    bool wait(TickType_t ticks);
+
+    uint32_t getFrameCount(void) const { return m_frame_count; }
+    const ArrayList<uint8_t> &getLastFrame(void) const { return m_frame; }
+    // Wire time of one transfer of len bytes, latch included
+    uint32_t getTransferTime(size_t len) const;
+
+  private:
+    uint32_t m_bit_ns;
+    bool m_sending;
+    uint32_t m_done_us;
+    uint32_t m_frame_count;
+    ArrayList<uint8_t> m_frame;
+};
+
+// Best output available on this target for a strip on pin
+ILedOutput *CreateLedOutput(Adafruit_NeoPixel &strip, int16_t pin,
+                            neoPixelType type);
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef __NETWORK_INPUT_H__
+#define __NETWORK_INPUT_H__
+
+#include "led_controller.h"
+#include "pixel_space.h"
+#include "utils.h"
+
+#define DDP_PORT 4048
+#define E131_PORT 5568
+// Channels of a DMX universe hold 170 whole RGB pixels
+#define E131_PIXELS_PER_UNIVERSE 170
+// Largest packet read, DDP packets of 480 pixels fit a 1500 byte MTU
+#define NETWORK_INPUT_PACKET_SIZE 1500
+// Universes that must all arrive before an E1.31 frame without
+// synchronization packets is published
+#define NETWORK_INPUT_MAX_UNIVERSES 64
+// Longest the task blocks waiting for a packet, bounds how long stop() takes
+#define NETWORK_INPUT_TIMEOUT_MS 100
+
+struct NetworkInputStats {
+    uint32_t packets;
+    // Older than the last packet of the same stream, or repeated
+    uint32_t out_of_order;
+    // Not DDP with RGB pixels or E1.31, or for a universe that is not mapped
+    uint32_t ignored;
+    uint32_t frames;
+};
+
+/**
+ * Receives pixels over UDP, DDP on DDP_PORT and E1.31 (sACN) on E131_PORT,
+ * and writes the RGB payload straight from the receive buffer into the back
+ * frame of the strips. The strips are laid end to end in a PixelSpace: DDP
+ * offsets index it directly and every mapped E1.31 universe covers a range
+ * of it.
+ *
+ * A frame is published to the strips on a DDP packet with the push flag, on
+ * an E1.31 synchronization packet, or for E1.31 streams without
+ * synchronization once every mapped universe was received. The input must be
+ * the only writer of its strips, do not run effects on them at the same
+ * time.
+ *
+ *   NetworkInput *input = new NetworkInput();
+ *   input->addStrip(led_strip);
+ *   input->mapUniverses(1, 24);
+ *   input->start();
+ */
+class NetworkInput : public ITaskManager {
+  public:
+    // A port of 0 disables the protocol. The task sleeps on the sockets and
+    // drains them as soon as a packet arrives.
+    NetworkInput(uint16_t ddp_port = DDP_PORT, uint16_t e131_port = E131_PORT,
+                 BaseType_t core = 0);
+    ~NetworkInput();
+
+    // Append strip, or count pixels of it from start, to the pixel space
+    void addStrip(LedStrip *strip) { m_space.addStrip(strip); }
+    void addSegment(LedStrip *strip, uint16_t start, uint16_t count) {
+        m_space.addSegment(strip, start, count);
+    }
+    uint32_t getNumPixels(void) const { return m_space.getNumPixels(); }
+
+    // E1.31 universe written to the pixel space from first_pixel
+    bool mapUniverse(uint16_t universe, uint32_t first_pixel,
+                     uint16_t count = E131_PIXELS_PER_UNIVERSE);
+    // count consecutive universes from first, each one
+    // E131_PIXELS_PER_UNIVERSE pixels after the previous one
+    bool mapUniverses(uint16_t first, uint16_t count);
+
+    // Open the sockets, done by the task if not called before
+    bool begin(void);
+    void end(void);
+    // Handle every packet waiting on the sockets, returns how many
+    uint32_t poll(void);
+
+    // Parse one packet, poll() calls them on what it receives
+    bool handleDdp(const uint8_t *data, size_t len);
+    bool handleE131(const uint8_t *data, size_t len);
+
+    const NetworkInputStats &getStats(void) const { return m_stats; }
+
+  protected:
+    void waitForUpdate(void);
+    void setup(void);
+    void update(void);
+    void cleanup(void);
+
+  private:
+    struct Universe {
+        uint16_t number;
+        uint16_t count;
+        uint32_t first_pixel;
+        uint8_t sequence;
+        bool seen;
+    };
+
+    int openSocket(uint16_t port);
+    uint32_t drain(int socket, bool ddp);
+    void publish(void);
+
+    PixelSpace m_space;
+    ArrayList<Universe> m_universes;
+    // Universes received since the last frame, one bit per universe index
+    uint64_t m_received;
+    uint64_t m_all_received;
+    // Universe whose E1.31 synchronization packets publish the frame, 0
+    // when the sender does not synchronize
+    uint16_t m_sync_address;
+    uint8_t m_sync_sequence;
+    bool m_sync_seen;
+    uint16_t m_ddp_port;
+    uint16_t m_e131_port;
+    int m_ddp_socket;
+    int m_e131_socket;
+    uint8_t m_ddp_sequence;
+    NetworkInputStats m_stats;
+    uint8_t m_packet[NETWORK_INPUT_PACKET_SIZE];
+};
+
+/**
+ * Packet builders for senders, return the packet size or 0 if it does not
+ * fit in size bytes. rgb holds count pixels as R, G, B bytes.
+ */
+size_t BuildDdpPacket(uint8_t *packet, size_t size, uint8_t sequence,
+                      uint32_t first_pixel, const uint8_t *rgb, uint16_t count,
+                      bool push);
+// sync_address 0 sends the universe without synchronization
+size_t BuildE131Packet(uint8_t *packet, size_t size, uint8_t sequence,
+                       uint16_t universe, uint16_t sync_address,
+                       const uint8_t *rgb, uint16_t count);
+size_t BuildE131Sync(uint8_t *packet, size_t size, uint8_t sequence,
+                     uint16_t sync_address);
+
+#endif
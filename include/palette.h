@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "fixed.h"
 #include "utils.h"
 
 class Color {
@@ -54,28 +55,127 @@ class Color {
     };
 };
 
+namespace palette_detail {
+constexpr uint32_t channel(uint32_t color, int shift) {
+    return (color >> shift) & 0xff;
+}
+
+// Same rounding as Color::operator*
+constexpr uint32_t correct(uint32_t color, uint32_t correction) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        result |= ((channel(color, shift) * channel(correction, shift) + 127) /
+                   255)
+                  << shift;
+    }
+    return result;
+}
+
+// Color of data on a palette with the stops spread evenly over
+// [0, resolution], mirrors Palette::interp
+template <size_t N>
+constexpr uint32_t interp(const uint32_t (&colors)[N], uint32_t resolution,
+                          uint32_t data) {
+    uint32_t step = resolution / (N - 1);
+    for (size_t i = 0; i < N; i++) {
+        uint32_t end = i == N - 1 ? resolution : i * step;
+        if (data < end) {
+            uint32_t start = (i - 1) * step;
+            uint32_t pos = data - start;
+            uint32_t span = end - start;
+            uint32_t from = colors[i - 1];
+            uint32_t to = colors[i];
+            return ((uint32_t)lerp_u8(channel(from, 16), channel(to, 16), pos,
+                                      span)
+                    << 16) |
+                   ((uint32_t)lerp_u8(channel(from, 8), channel(to, 8), pos,
+                                      span)
+                    << 8) |
+                   lerp_u8(channel(from, 0), channel(to, 0), pos, span);
+        }
+    }
+    return colors[N - 1];
+}
+} // namespace palette_detail
+
+/**
+ * Palette whose lookup table is computed by the compiler, declare it
+ * constexpr and the table lands in flash. Palette reads it in place.
+ *
+ *   inline constexpr StaticPalette<255> FIRE({0x000000, 0xff0000}, 0xffffff);
+ */
+template <uint16_t RESOLUTION> class StaticPalette {
+  public:
+    template <size_t N>
+    constexpr StaticPalette(const uint32_t (&colors)[N], uint32_t correction)
+        : m_lut() {
+        static_assert(N >= 2, "a palette needs at least two colors");
+        for (uint32_t i = 0; i <= RESOLUTION; i++) {
+            m_lut[i] = palette_detail::correct(
+                palette_detail::interp(colors, RESOLUTION, i), correction);
+        }
+    }
+
+    // Color is a single packed word, the table is read as colors
+    const Color *table(void) const {
+        return reinterpret_cast<const Color *>(m_lut);
+    }
+    static constexpr size_t count(void) { return RESOLUTION + 1; }
+
+  private:
+    uint32_t m_lut[RESOLUTION + 1];
+};
+
 class Palette {
   public:
-    static const uint8_t GAMMA[];
+    // Both point the copy at its own lookup table
     Palette(const Palette &other);
+    Palette &operator=(const Palette &other);
+    // Reads the table of palette in place, nothing is copied
+    template <uint16_t RESOLUTION>
+    Palette(const StaticPalette<RESOLUTION> &palette)
+        : Palette(palette.table(), palette.count()) {}
+    // Palette over a table of count corrected colors owned by the caller
+    Palette(const Color *table, size_t count);
     Palette(uint16_t resolution, const Color &colors,
             const Color &color_correction);
-    Palette(uint16_t resolution, const ArrayList<Color> &colors,
+    Palette(uint16_t resolution, Span<const Color> colors,
             const Color &color_correction);
 
-    void correct_colors(ArrayList<Color> &colors);
+    void correct_colors(Span<Color> colors);
     void correct_colors(Color &colors);
 
     /**
      * linear interpolation
      */
-    void interp(ArrayList<uint32_t> data, ArrayList<Color> &colors);
+    void interp(Span<const uint32_t> data, Span<Color> colors);
     void interp(uint32_t data, Color &color);
 
+    /**
+     * Table lookup of the interpolated and corrected color, values above the
+     * palette resolution map to the last color.
+     */
+    void lookup(uint32_t data, Color &color) const {
+        size_t last = m_table_count - 1;
+        color = m_table[data < last ? data : last];
+    }
+
+    // RAM used by the lookup table in bytes, 0 for tables in flash
+    size_t getLutSize(void) const { return m_lut.count() * sizeof(Color); }
+    // Time spent building the lookup table in microseconds
+    uint32_t getLutBuildTime(void) const { return m_lut_build_time; }
+
   private:
+    void buildLut(void);
+
     ArrayList<Color> m_colors;
     ArrayList<uint32_t> m_colors_map;
     Color m_color_correction;
+    ArrayList<Color> m_lut;
+    uint32_t m_lut_build_time;
+    // Table read by lookup(), m_lut or a table owned by someone else
+    const Color *m_table;
+    size_t m_table_count;
 };
 
 Palette RainbowPalette(uint32_t resolution = 255);
@@ -0,0 +1,30 @@
+#ifndef __PALETTES_H__
+#define __PALETTES_H__
+
+#include "palette.h"
+
+/**
+ * Built-in palettes, the tables are computed at compile time and live in
+ * flash. Effects share them through Palette without any copy.
+ */
+namespace palettes {
+inline constexpr uint32_t RAINBOW_COLORS[] = {
+    0xFF0000, 0xFFFF00, 0x00FF00, 0x00FFFF, 0x0000FF, 0xFF00FF, 0xFF0000};
+inline constexpr uint32_t HEAT_COLORS[] = {0x000000, 0xFF0000, 0xFFFF00,
+                                           0xFFFFFF};
+inline constexpr uint32_t OCEAN_COLORS[] = {0x000000, 0x0000FF, 0x0080FF,
+                                            0x00FFFF};
+inline constexpr uint32_t WHITE_COLORS[] = {0x000000, 0xFFFFFF};
+
+// Same colors as RainbowPalette(), green and blue are toned down so the
+// mixed colors keep the hue of the pure ones
+inline constexpr uint32_t RAINBOW_CORRECTION = 0xFF7878;
+inline constexpr StaticPalette<255> RAINBOW(RAINBOW_COLORS, RAINBOW_CORRECTION);
+inline constexpr StaticPalette<8> RAINBOW_8(RAINBOW_COLORS, RAINBOW_CORRECTION);
+inline constexpr StaticPalette<255> HEAT(HEAT_COLORS, 0xFFFFFF);
+inline constexpr StaticPalette<255> OCEAN(OCEAN_COLORS, 0xFFFFFF);
+// Black to white, same as Palette(255, Color::WHITE, Color::WHITE)
+inline constexpr StaticPalette<255> WHITE(WHITE_COLORS, 0xFFFFFF);
+} // namespace palettes
+
+#endif
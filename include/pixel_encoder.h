@@ -0,0 +1,36 @@
+#ifndef __PIXEL_ENCODER_H__
+#define __PIXEL_ENCODER_H__
+
+#include <Adafruit_NeoPixel.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "palette.h"
+
+// Writes count colors to the pixels starting at first, returns non zero if
+// any byte changed
+typedef uint8_t (*PixelSpanEncoder)(uint8_t *buffer, uint16_t first,
+                                    const ::Color *colors, size_t count);
+// Writes colors[i] to pixel indexes[i]
+typedef uint8_t (*PixelMapEncoder)(uint8_t *buffer, const uint16_t *indexes,
+                                   const ::Color *colors, size_t count);
+// Writes count pixels given as R, G, B bytes, white is set to 0
+typedef uint8_t (*PixelRgbEncoder)(uint8_t *buffer, uint16_t first,
+                                   const uint8_t *rgb, size_t count);
+
+/**
+ * Frame encoders for one color order, with the byte offsets and the pixel
+ * size fixed at compile time. RGBW orders take the white channel from
+ * Color::W().
+ */
+struct PixelEncoder {
+    PixelSpanEncoder span;
+    PixelMapEncoder mapped;
+    PixelRgbEncoder rgb;
+};
+
+// Encoders for the color order of type, all nullptr if it is not a known
+// NEO_* order
+PixelEncoder GetPixelEncoder(neoPixelType type);
+
+#endif
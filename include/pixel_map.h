@@ -0,0 +1,55 @@
+#ifndef __PIXEL_MAP_H__
+#define __PIXEL_MAP_H__
+
+#include <stdint.h>
+
+#include "utils.h"
+
+// Layout flags for PixelMap::matrix
+#define MATRIX_ROWS 0x00
+#define MATRIX_COLUMNS 0x01
+#define MATRIX_SERPENTINE 0x02
+#define MATRIX_FLIP_X 0x04
+#define MATRIX_FLIP_Y 0x08
+
+/**
+ * Maps the logical pixel index of a segment to its physical index on the
+ * strip. Linear maps are a plain offset, every other layout is resolved once
+ * into a table so writing through it costs a single lookup per pixel.
+ */
+class PixelMap {
+  public:
+    PixelMap(void) : m_start(0), m_count(0), m_max(0), m_table() {}
+    LED_ARENA_ALLOCATED
+
+    static PixelMap linear(uint16_t start, uint16_t count);
+    static PixelMap reversed(uint16_t start, uint16_t count);
+    // Every stride-th pixel from start
+    static PixelMap interleaved(uint16_t start, uint16_t count,
+                                uint16_t stride);
+    // width x height matrix, logical index is y * width + x
+    static PixelMap matrix(uint16_t start, uint16_t width, uint16_t height,
+                           uint8_t layout = MATRIX_ROWS);
+
+    uint16_t operator[](size_t index) const {
+        return isLinear() ? m_start + index : m_table[index];
+    }
+
+    bool isLinear(void) const { return m_table.count() == 0; }
+    uint16_t start(void) const { return m_start; }
+    uint16_t count(void) const { return m_count; }
+    // Highest physical index, used to validate the map once
+    uint16_t maxIndex(void) const { return m_max; }
+    const uint16_t *table(void) const { return m_table.data(); }
+
+  private:
+    PixelMap(uint16_t start, uint16_t count);
+    void set(uint16_t index, uint16_t physical);
+
+    uint16_t m_start;
+    uint16_t m_count;
+    uint16_t m_max;
+    ArrayList<uint16_t> m_table;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef __PIXEL_SPACE_H__
+#define __PIXEL_SPACE_H__
+
+#include "led_controller.h"
+#include "utils.h"
+
+/**
+ * Strips, or segments of them, laid end to end in one pixel space. Inputs
+ * addressing pixels by their index in that space, NetworkInput and
+ * SerialInput, write them through it into the back frame of the strips.
+ *
+ *   PixelSpace space;
+ *   space.addStrip(led_strip);
+ *   space.writeRgb(first, rgb, count);
+ *   space.publish();
+ */
+class PixelSpace {
+  public:
+    PixelSpace(void) : m_parts(), m_num_pixels(0) {}
+
+    // Append strip, or count pixels of it from start
+    void addStrip(LedStrip *strip);
+    void addSegment(LedStrip *strip, uint16_t start, uint16_t count);
+    uint32_t getNumPixels(void) const { return m_num_pixels; }
+
+    // count R, G, B pixels from first, pixels past the end are dropped
+    void writeRgb(uint32_t first, const uint8_t *rgb, uint32_t count);
+    // Show or drop what was written to the strips since the last publish
+    void publish(void);
+    void discard(void);
+
+  private:
+    struct Part {
+        LedStrip *strip;
+        uint16_t start;
+        uint16_t count;
+        uint32_t offset;
+    };
+
+    ArrayList<Part> m_parts;
+    uint32_t m_num_pixels;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef __RANDOM_H__
+#define __RANDOM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Xorshift32 generator. Each effect owns one, so effects rendered on
+ * different cores never share state, and the same seed always replays the
+ * same sequence on every build and target.
+ */
+class Random {
+  public:
+    static const uint32_t DEFAULT_SEED = 0x2545f491u;
+
+    explicit Random(uint32_t seed = DEFAULT_SEED) { setSeed(seed); }
+
+    // Any value is a valid seed, close seeds still give unrelated sequences
+    void setSeed(uint32_t seed) {
+        // Murmur3 finalizer, the state must never be 0
+        seed += 0x9e3779b9u;
+        seed = (seed ^ (seed >> 16)) * 0x85ebca6bu;
+        seed = (seed ^ (seed >> 13)) * 0xc2b2ae35u;
+        seed ^= seed >> 16;
+        m_state = seed != 0 ? seed : 1;
+    }
+
+    uint32_t next(void) {
+        uint32_t x = m_state;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        m_state = x;
+        return x;
+    }
+
+    // Value in [0, range), multiply and shift instead of a division
+    uint32_t below(uint32_t range) {
+        return (uint32_t)(((uint64_t)next() * range) >> 32);
+    }
+
+    // Value in [min, max]
+    int32_t between(int32_t min, int32_t max) {
+        return min + (int32_t)below((uint32_t)(max - min) + 1);
+    }
+
+    void fill(uint32_t *values, size_t count) {
+        uint32_t x = m_state;
+        for (size_t i = 0; i < count; i++) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            values[i] = x;
+        }
+        m_state = x;
+    }
+
+    // count indexes in [0, range), same values as calling below() count times
+    template <typename T>
+    void indexes(T *values, size_t count, uint32_t range) {
+        uint32_t x = m_state;
+        for (size_t i = 0; i < count; i++) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            values[i] = (T)(((uint64_t)x * range) >> 32);
+        }
+        m_state = x;
+    }
+
+  private:
+    uint32_t m_state;
+};
+
+#endif
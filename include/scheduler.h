@@ -0,0 +1,78 @@
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <FreeRTOS.h>
+#include <esp_timer.h>
+#include <stdint.h>
+#include <task.h>
+
+// What to do when a frame starts after its deadline
+enum OverrunPolicy {
+    // Drop the late frames and wait for the next deadline on the grid
+    OVERRUN_SKIP,
+    // Run the late frames back to back until the schedule is met again
+    OVERRUN_CATCH_UP,
+    // Restart the grid from now, the phase is lost
+    OVERRUN_SLIP,
+};
+
+/**
+ * Wakes a task at the absolute deadlines epoch + phase + frame / rate.
+ * Deadlines are computed from the frame number so rounding never adds up, and
+ * the wait uses a one-shot esp_timer so periods are not rounded to RTOS ticks.
+ * Schedulers with the same rate share one epoch and so stay phase locked.
+ */
+class FrameScheduler {
+  public:
+    FrameScheduler(uint32_t rate = 60);
+    ~FrameScheduler();
+
+    // Takes effect on the next start(), a rate of 0 runs at 1 frame/s
+    void setRate(uint32_t rate) { m_rate = rate > 0 ? rate : 1; }
+    void setPolicy(OverrunPolicy policy) { m_policy = policy; }
+    // Offset of the deadlines from the shared epoch in microseconds
+    void setPhase(int32_t phase_us) { m_phase = phase_us; }
+
+    // Start on the next deadline, must run on the task that calls wait()
+    void start(void);
+    // Stop waking the task, call before the task that called start() ends
+    void stop(void);
+    // Sleep until the next frame is due, returns the frames dropped or run
+    // late because of an overrun
+    uint32_t wait(void);
+
+    uint32_t getRate(void) const { return m_rate; }
+    uint32_t getOverruns(void) const { return m_overruns; }
+    // Deadline of the frame returned by the last wait()
+    int64_t getDeadline(void) const { return deadline(m_frame - 1); }
+
+    // Set the shared epoch to now unless it is already set, call before
+    // starting the tasks
+    static void initEpoch(void);
+    static void setEpoch(int64_t epoch_us) { s_epoch = epoch_us; }
+    static int64_t getEpoch(void) { return s_epoch; }
+
+  private:
+    static void timerCallback(void *arg);
+    int64_t deadline(uint64_t frame) const {
+        return m_anchor + m_phase + (int64_t)((frame * 1000000ULL) / m_rate);
+    }
+    // First frame due after time_us
+    uint64_t frameAfter(int64_t time_us) const;
+    void sleepUntil(int64_t time_us);
+
+    static int64_t s_epoch;
+
+    uint32_t m_rate;
+    OverrunPolicy m_policy;
+    int32_t m_phase;
+    // Time of frame 0, the shared epoch until a slip moves it
+    int64_t m_anchor;
+    // Next frame to run
+    uint64_t m_frame;
+    uint32_t m_overruns;
+    TaskHandle_t m_task;
+    esp_timer_handle_t m_timer;
+};
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef __SERIAL_INPUT_H__
+#define __SERIAL_INPUT_H__
+
+#include <atomic>
+
+#include "led_controller.h"
+#include "pixel_space.h"
+#include "utils.h"
+
+/**
+ * Packets read from the serial port, numbers are big endian:
+ *
+ *   Adalight  "Ada", count - 1 (2), check, count R, G, B pixels
+ *   extended  "Led", type, first pixel (2), count (2), check, payload,
+ *             Fletcher-16 of type up to the end of the payload (2)
+ *
+ * check is the XOR of the bytes between the magic and itself XORed with
+ * 0x55. Adalight frames start at pixel 0 and are published at the end.
+ * The low bits of the extended type select the payload:
+ *
+ *   SERIAL_FRAME  count R, G, B pixels from first
+ *   SERIAL_DELTA  tokens covering count pixels from first: 0x00-0x7f skips
+ *                 token + 1 unchanged pixels, 0x80-0xff is followed by
+ *                 token - 0x7f R, G, B pixels
+ *
+ * SERIAL_PUSH in the type publishes the frame after the packet, so a frame
+ * may be sent in several packets. A packet failing its checksum drops every
+ * pixel written since the last published frame.
+ */
+#define SERIAL_ADALIGHT_MAGIC "Ada"
+#define SERIAL_MAGIC "Led"
+#define SERIAL_ADALIGHT_HEADER_SIZE 6
+#define SERIAL_HEADER_SIZE 9
+#define SERIAL_CHECKSUM_SIZE 2
+#define SERIAL_FRAME 0x01
+#define SERIAL_DELTA 0x02
+#define SERIAL_TYPE_MASK 0x0f
+#define SERIAL_PUSH 0x80
+// Bytes taken from the stream at once
+#define SERIAL_INPUT_CHUNK_SIZE 256
+// A packet not complete after this long is dropped, the sender went away.
+// The task also sleeps no longer than this between two reads.
+#define SERIAL_INPUT_TIMEOUT_MS 100
+// isStreaming() stays true this long after the last packet
+#define SERIAL_INPUT_IDLE_MS 1000
+
+struct SerialInputStats {
+    uint32_t bytes;
+    uint32_t packets;
+    uint32_t frames;
+    // Packets with a bad header or checksum, or cut off by the timeout
+    uint32_t errors;
+    // Bytes outside of packets
+    uint32_t ignored;
+};
+
+/**
+ * Reads pixel packets from a serial port, e.g. the USB CDC port of the
+ * ESP32-S3, and writes them into the back frame of the strips as they arrive.
+ * The parser keeps no more than one partial pixel of a packet, pixels are
+ * encoded straight from the chunk read. The strips are laid end to end in a
+ * PixelSpace like for NetworkInput.
+ *
+ * Bytes outside of packets go to the command handler, so single key commands
+ * typed in a terminal still work. While disabled packets are parsed but not
+ * written, another writer such as the effects may own the strips then.
+ *
+ *   SerialInput *input = new SerialInput(&Serial);
+ *   input->addStrip(led_strip);
+ *   input->start();
+ */
+class SerialInput : public ITaskManager {
+  public:
+    typedef void (*CommandHandler)(uint8_t command);
+
+    // The task sleeps until notifyReceived() and then handles the bytes
+    // waiting on the stream
+    SerialInput(Stream *stream, BaseType_t core = 0);
+    ~SerialInput();
+
+    // Append strip, or count pixels of it from start, to the pixel space
+    void addStrip(LedStrip *strip) { m_space.addStrip(strip); }
+    void addSegment(LedStrip *strip, uint16_t start, uint16_t count) {
+        m_space.addSegment(strip, start, count);
+    }
+    uint32_t getNumPixels(void) const { return m_space.getNumPixels(); }
+
+    void setCommandHandler(CommandHandler handler) { m_handler = handler; }
+    // Waits for the chunk being handled, once disabled the input writes
+    // nothing more to the strips and another writer may start
+    void setEnabled(bool enable);
+    bool isEnabled(void) const { return m_enabled; }
+    // True if a packet was received in the last SERIAL_INPUT_IDLE_MS
+    bool isStreaming(void) const;
+
+    // Wake the task, call it from the receive callback of the stream.
+    // Without one the task reads every SERIAL_INPUT_TIMEOUT_MS.
+    void notifyReceived(void) { xSemaphoreGive(m_received); }
+    // Handle the bytes waiting on the stream, returns how many
+    uint32_t poll(void);
+    // Parse len more bytes of the stream, poll() calls it on what it reads
+    // holding the lock setEnabled() waits for
+    void feed(const uint8_t *data, size_t len);
+
+    const SerialInputStats &getStats(void) const { return m_stats; }
+
+  protected:
+    void waitForUpdate(void);
+    void setup(void);
+    void update(void);
+    void cleanup(void) {}
+
+  private:
+    enum State {
+        STATE_MAGIC,
+        STATE_HEADER,
+        STATE_PIXELS,
+        STATE_TOKEN,
+        STATE_CHECKSUM,
+    };
+    bool parseHeader(void);
+    // Pixels of the current run from data, returns the bytes used
+    size_t readPixels(const uint8_t *data, size_t len);
+    void readToken(uint8_t token);
+    // All pixels of the packet were read
+    void endPayload(void);
+    void endPacket(bool valid);
+    void addChecksum(const uint8_t *data, size_t len);
+    void writePixels(uint32_t first, const uint8_t *rgb, uint32_t count) {
+        if (m_enabled) {
+            m_space.writeRgb(first, rgb, count);
+        }
+    }
+
+    Stream *m_stream;
+    PixelSpace m_space;
+    CommandHandler m_handler;
+    std::atomic<bool> m_enabled;
+    std::atomic<uint32_t> m_last_packet_ms;
+    uint32_t m_last_byte_ms;
+
+    State m_state;
+    // Magic being matched and how many of its bytes were seen
+    const char *m_magic;
+    uint8_t m_matched;
+    // Extended packet, otherwise Adalight
+    bool m_extended;
+    uint8_t m_header[SERIAL_HEADER_SIZE];
+    uint8_t m_header_len;
+    uint8_t m_type;
+    // Next pixel written, end of the packet and pixels left in the run
+    uint32_t m_pos;
+    uint32_t m_end;
+    uint32_t m_run;
+    // Bytes of a pixel split between two chunks
+    uint8_t m_pixel[3];
+    uint8_t m_pixel_len;
+    uint16_t m_sum1;
+    uint16_t m_sum2;
+
+    SerialInputStats m_stats;
+    uint8_t m_chunk[SERIAL_INPUT_CHUNK_SIZE];
+    // Given by notifyReceived(), outlives the task unlike its handle
+    SemaphoreHandle_t m_received;
+    SemaphoreHandle_t m_lock;
+};
+
+/**
+ * Packet builders for senders, return the packet size or 0 if it does not
+ * fit in size bytes. rgb holds count pixels as R, G, B bytes.
+ */
+// Header of an Adalight frame, the count pixels follow it
+size_t BuildAdalightHeader(uint8_t *header, uint16_t count);
+size_t BuildSerialFrame(uint8_t *packet, size_t size, uint16_t first,
+                        const uint8_t *rgb, uint16_t count, bool push);
+// Pixels equal in rgb and previous are skipped, at most
+// SERIAL_HEADER_SIZE + 3 * count + count / 128 + 3 bytes
+size_t BuildSerialDelta(uint8_t *packet, size_t size, uint16_t first,
+                        const uint8_t *rgb, const uint8_t *previous,
+                        uint16_t count, bool push);
+
+#endif
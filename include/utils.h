@@ -6,46 +6,138 @@
 #include <semphr.h>
 #include <string.h>
 
+#include "arena.h"
+#include "scheduler.h"
+
 #define COUNT_OF(array) (sizeof(array) / sizeof(array[0]))
 
+/**
+ * Non-owning view on count elements. Cheap to pass by value, the memory must
+ * outlive the span. Span<const T> converts from Span<T>.
+ */
+template <typename T> class Span {
+  public:
+    Span() : m_data(nullptr), m_count(0) {}
+    Span(T *data, size_t count) : m_data(data), m_count(count) {}
+    template <size_t N> Span(T (&array)[N]) : m_data(array), m_count(N) {}
+    template <typename U>
+    Span(const Span<U> &other) : m_data(other.data()), m_count(other.count()) {}
+
+    T &operator[](size_t index) const { return m_data[index]; }
+    T *data() const { return m_data; }
+    size_t count() const { return m_count; }
+    T *begin() const { return m_data; }
+    T *end() const { return m_data + m_count; }
+
+    // count elements from start, clamped to the end of the span
+    Span subspan(size_t start, size_t count) const {
+        if (start > m_count) {
+            start = m_count;
+        }
+        if (count > m_count - start) {
+            count = m_count - start;
+        }
+        return Span(m_data + start, count);
+    }
+
+  private:
+    T *m_data;
+    size_t m_count;
+};
+
+/**
+ * Storage comes from led_malloc, region tells where it should live when an
+ * ArenaScope is open.
+ */
 template <typename T> class ArrayList {
   public:
-    ArrayList() : m_data(nullptr), m_count(0), m_data_len(0) {}
+    ArrayList()
+        : m_data(nullptr), m_count(0), m_data_len(0), m_region(MEMORY_COLD) {}
 
     ArrayList(const ArrayList &other)
-        : ArrayList(other.m_data, other.m_count) {}
+        : ArrayList(other.m_data, other.m_count, other.m_region) {}
 
-    ArrayList(size_t max_size) {
-        m_data = (T *)calloc(max_size, sizeof(T));
+    ArrayList(ArrayList &&other)
+        : m_data(other.m_data), m_count(other.m_count),
+          m_data_len(other.m_data_len), m_region(other.m_region) {
+        other.m_data = nullptr;
+        other.m_count = 0;
+        other.m_data_len = 0;
+    }
+
+    ArrayList(size_t max_size, MemoryRegion region = MEMORY_COLD) {
+        m_data = (T *)led_calloc(max_size, sizeof(T), region);
         m_data_len = max_size;
         m_count = max_size;
+        m_region = region;
     }
 
-    ArrayList(const T *data, size_t data_len) {
-        m_data = (T *)malloc(sizeof(T) * data_len);
+    ArrayList(const T *data, size_t data_len,
+              MemoryRegion region = MEMORY_COLD) {
+        m_data = (T *)led_malloc(sizeof(T) * data_len, region);
         m_data_len = data_len;
         m_count = data_len;
+        m_region = region;
         memcpy((void *)m_data, (void *)data, sizeof(T) * m_data_len);
     }
 
     ~ArrayList() {
         if (m_data != nullptr) {
-            free(m_data);
+            led_free(m_data);
+        }
+    }
+
+    ArrayList &operator=(const ArrayList &other) {
+        if (this != &other) {
+            m_count = 0;
+            resize(other.m_count);
+            if (other.m_count > 0) {
+                memcpy((void *)m_data, (void *)other.m_data,
+                       sizeof(T) * other.m_count);
+            }
+            m_count = other.m_count;
+        }
+        return *this;
+    }
+
+    ArrayList &operator=(ArrayList &&other) {
+        if (this != &other) {
+            if (m_data != nullptr) {
+                led_free(m_data);
+            }
+            m_data = other.m_data;
+            m_count = other.m_count;
+            m_data_len = other.m_data_len;
+            m_region = other.m_region;
+            other.m_data = nullptr;
+            other.m_count = 0;
+            other.m_data_len = 0;
         }
+        return *this;
     }
 
-    void resize(size_t data_len) {
+    // Grow the capacity to data_len, the elements are kept. False if the
+    // memory ran out, the list is unchanged then.
+    bool resize(size_t data_len) {
         if (m_data_len < data_len) {
-            T *old_data = m_data;
-            m_data = (T *)malloc(sizeof(T) * data_len);
-            m_data_len = data_len;
-            if (old_data != nullptr) {
-                if (m_count > 0) {
-                    memcpy(m_data, old_data, sizeof(T) * m_count);
-                }
-                free(old_data);
+            T *data = (T *)led_realloc((void *)m_data, sizeof(T) * data_len,
+                                       m_region);
+            if (data == nullptr) {
+                return false;
             }
+            m_data = data;
+            m_data_len = data_len;
         }
+        return true;
+    }
+
+    // Grow the capacity to at least data_len, doubling it at the least so a
+    // list grown one element at a time is not moved on every add
+    bool reserve(size_t data_len) {
+        if (m_data_len >= data_len) {
+            return true;
+        }
+        return resize(data_len > 2 * m_data_len ? data_len : 2 * m_data_len);
     }
 
     bool add(const T &data) {
@@ -70,6 +162,9 @@ template <typename T> class ArrayList {
         return false;
     }
 
+    // Remove every element, the capacity is kept
+    void clear() { m_count = 0; }
+
     T &operator[](size_t index) { return m_data[index]; }
 
     T operator[](size_t index) const { return m_data[index]; }
@@ -80,6 +175,9 @@ template <typename T> class ArrayList {
 
     size_t count() const { return m_count; }
 
+    operator Span<T>() { return Span<T>(m_data, m_count); }
+    operator Span<const T>() const { return Span<const T>(m_data, m_count); }
+
     void foreach (std::function<T &> op) {
         for (int i = 0; i < m_count; i++) {
             op(m_data[i]);
@@ -90,6 +188,58 @@ template <typename T> class ArrayList {
     T *m_data;
     size_t m_count;
     size_t m_data_len;
+    MemoryRegion m_region;
+};
+
+/**
+ * ArrayList with its storage inline, for lists with a small fixed maximum
+ * size that should never touch the heap. add() fails once N elements are
+ * stored.
+ */
+template <typename T, size_t N> class InlineArrayList {
+  public:
+    InlineArrayList() : m_count(0) {}
+
+    bool add(const T &data) {
+        if (m_count >= N) {
+            return false;
+        }
+        m_data[m_count] = data;
+        m_count++;
+        return true;
+    }
+
+    bool remove(const T &data) {
+        for (size_t i = 0; i < m_count; i++) {
+            if (m_data[i] == data) {
+                m_data[i] = m_data[m_count - 1];
+                m_count--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void clear() { m_count = 0; }
+
+    T &operator[](size_t index) { return m_data[index]; }
+
+    T operator[](size_t index) const { return m_data[index]; }
+
+    T *data() { return m_data; }
+
+    const T *data() const { return m_data; }
+
+    size_t count() const { return m_count; }
+
+    size_t capacity() const { return N; }
+
+    operator Span<T>() { return Span<T>(m_data, m_count); }
+    operator Span<const T>() const { return Span<const T>(m_data, m_count); }
+
+  private:
+    T m_data[N];
+    size_t m_count;
 };
 
 class Mutex {
@@ -119,16 +269,74 @@ class LockGuard {
 
 void hex_dump(const void *data, size_t data_len);
 
+#define TASK_STATS_BUCKETS 12
+// Upper bound of the first histogram bucket, each next one doubles it
+#define TASK_STATS_FIRST_BUCKET_US 64
+// Frames between two samples of the free stack, getting it scans the stack
+#define TASK_STATS_STACK_EVERY 64
+
+/**
+ * Runtime metrics of an ITaskManager. histogram[i] counts the update() calls
+ * shorter than TASK_STATS_FIRST_BUCKET_US << i, the last bucket also counts
+ * everything longer.
+ */
+struct TaskStats {
+    uint32_t frames;
+    // Frames that started after their deadline
+    uint32_t overruns;
+    // update() calls longer than one frame period
+    uint32_t over_budget;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t busy_us;
+    // Time the stats cover
+    uint64_t elapsed_us;
+    // Share of elapsed time spent in update(), in 1/1000
+    uint32_t cpu_permille;
+    // Least free stack seen so far in bytes, sampled on the first frame and
+    // every TASK_STATS_STACK_EVERY frames
+    uint32_t stack_free;
+    uint32_t histogram[TASK_STATS_BUCKETS];
+};
+
 class ITaskManager {
   public:
     ITaskManager(uint32_t refresh_rate = 60, BaseType_t core = 0);
+    virtual ~ITaskManager() {}
 
     virtual void start(void);
     virtual void stop(void);
+    // False once a stopped task has finished its last update()
+    bool isRunning(void) const { return m_task_handler != nullptr; }
+
+    // Task settings, take effect on the next start()
+    void setName(const char *name) { m_name = name; }
+    void setPriority(UBaseType_t priority) { m_priority = priority; }
+    void setStackSize(uint32_t stack_size) { m_stack_size = stack_size; }
+
+    // Snapshot of the metrics, fields may be one frame apart as the task
+    // keeps running
+    void getStats(TaskStats &stats);
+    void resetStats(void);
+    // One line summary on Serial
+    void dumpStats(void);
+
+    // Both take effect on the next start()
+    void setOverrunPolicy(OverrunPolicy policy) {
+        m_scheduler.setPolicy(policy);
+    }
+    // Offset of the frame deadlines in microseconds, tasks running at the
+    // same rate are phase locked to each other
+    void setPhase(int32_t phase_us) { m_scheduler.setPhase(phase_us); }
+    uint32_t getOverruns(void) const { return m_scheduler.getOverruns(); }
 
   protected:
     static void ITaskManagerTask(void *ctx);
 
+    // Sleep until update() has work, the next frame by default. Tasks fed by
+    // an input override it to block on the input, with a timeout so that
+    // stop() is noticed, and run at a refresh rate of 0.
+    virtual void waitForUpdate(void) { m_scheduler.wait(); }
     virtual void setup(void) = 0;
     virtual void update(void) = 0;
     virtual void cleanup(void) = 0;
@@ -138,6 +346,16 @@ class ITaskManager {
     BaseType_t m_core;
     TaskHandle_t m_task_handler;
     bool m_stop;
+    FrameScheduler m_scheduler;
+    const char *m_name;
+    UBaseType_t m_priority;
+    uint32_t m_stack_size;
+
+  private:
+    void recordUpdate(uint32_t duration_us);
+
+    TaskStats m_stats;
+    int64_t m_stats_start;
 };
 
 #endif
@@ -0,0 +1,50 @@
+#include "Adafruit_NeoPixel.h"
+
+Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, int16_t p, neoPixelType t)
+    : begun(false), numLEDs(0), numBytes(0), pin(p), brightness(0),
+      pixels(nullptr), showCount(0) {
+    updateType(t);
+    updateLength(n);
+}
+
+Adafruit_NeoPixel::Adafruit_NeoPixel(void)
+    : begun(false), numLEDs(0), numBytes(0), pin(-1), brightness(0),
+      pixels(nullptr), rOffset(1), gOffset(0), bOffset(2), wOffset(1),
+      showCount(0) {}
+
+Adafruit_NeoPixel::~Adafruit_NeoPixel() { free(pixels); }
+
+void Adafruit_NeoPixel::show(void) { showCount++; }
+
+void Adafruit_NeoPixel::clear(void) {
+    if (pixels != nullptr) {
+        memset(pixels, 0, numBytes);
+    }
+}
+
+void Adafruit_NeoPixel::updateLength(uint16_t n) {
+    free(pixels);
+    numBytes = n * ((wOffset == rOffset) ? 3 : 4);
+    pixels = (uint8_t *)calloc(numBytes, 1);
+    numLEDs = (pixels != nullptr) ? n : 0;
+    if (pixels == nullptr) {
+        numBytes = 0;
+    }
+}
+
+void Adafruit_NeoPixel::updateType(neoPixelType t) {
+    wOffset = (t >> 6) & 0b11;
+    rOffset = (t >> 4) & 0b11;
+    gOffset = (t >> 2) & 0b11;
+    bOffset = t & 0b11;
+}
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint8_t r, uint8_t g,
+                                      uint8_t b) {
+    if (n < numLEDs) {
+        uint8_t *p = &pixels[n * ((wOffset == rOffset) ? 3 : 4)];
+        p[rOffset] = r;
+        p[gOffset] = g;
+        p[bOffset] = b;
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef __ADAFRUIT_NEOPIXEL_SHIM_H__
+#define __ADAFRUIT_NEOPIXEL_SHIM_H__
+
+// Host stand-in for the Adafruit NeoPixel library. Only the parts used by the
+// LED pipeline are provided; show() does not touch any hardware.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NEO_RGB ((0 << 6) | (0 << 4) | (1 << 2) | (2))
+#define NEO_RBG ((0 << 6) | (0 << 4) | (2 << 2) | (1))
+#define NEO_GRB ((1 << 6) | (1 << 4) | (0 << 2) | (2))
+#define NEO_GBR ((2 << 6) | (2 << 4) | (0 << 2) | (1))
+#define NEO_BRG ((1 << 6) | (1 << 4) | (2 << 2) | (0))
+#define NEO_BGR ((2 << 6) | (2 << 4) | (1 << 2) | (0))
+
+#define NEO_WRGB ((0 << 6) | (1 << 4) | (2 << 2) | (3))
+#define NEO_WRBG ((0 << 6) | (1 << 4) | (3 << 2) | (2))
+#define NEO_WGRB ((0 << 6) | (2 << 4) | (1 << 2) | (3))
+#define NEO_WGBR ((0 << 6) | (3 << 4) | (1 << 2) | (2))
+#define NEO_WBRG ((0 << 6) | (2 << 4) | (3 << 2) | (1))
+#define NEO_WBGR ((0 << 6) | (3 << 4) | (2 << 2) | (1))
+#define NEO_RWGB ((1 << 6) | (0 << 4) | (2 << 2) | (3))
+#define NEO_RWBG ((1 << 6) | (0 << 4) | (3 << 2) | (2))
+#define NEO_RGWB ((2 << 6) | (0 << 4) | (1 << 2) | (3))
+#define NEO_RGBW ((3 << 6) | (0 << 4) | (1 << 2) | (2))
+#define NEO_RBWG ((2 << 6) | (0 << 4) | (3 << 2) | (1))
+#define NEO_RBGW ((3 << 6) | (0 << 4) | (2 << 2) | (1))
+#define NEO_GWRB ((1 << 6) | (2 << 4) | (0 << 2) | (3))
+#define NEO_GWBR ((1 << 6) | (3 << 4) | (0 << 2) | (2))
+#define NEO_GRWB ((2 << 6) | (1 << 4) | (0 << 2) | (3))
+#define NEO_GRBW ((3 << 6) | (1 << 4) | (0 << 2) | (2))
+#define NEO_GBWR ((2 << 6) | (3 << 4) | (0 << 2) | (1))
+#define NEO_GBRW ((3 << 6) | (2 << 4) | (0 << 2) | (1))
+#define NEO_BWRG ((1 << 6) | (2 << 4) | (3 << 2) | (0))
+#define NEO_BWGR ((1 << 6) | (3 << 4) | (2 << 2) | (0))
+#define NEO_BRWG ((2 << 6) | (1 << 4) | (3 << 2) | (0))
+#define NEO_BRGW ((3 << 6) | (1 << 4) | (2 << 2) | (0))
+#define NEO_BGWR ((2 << 6) | (3 << 4) | (1 << 2) | (0))
+#define NEO_BGRW ((3 << 6) | (2 << 4) | (1 << 2) | (0))
+
+#define NEO_KHZ800 0x0000
+#define NEO_KHZ400 0x0100
+
+typedef uint16_t neoPixelType;
+
+class Adafruit_NeoPixel {
+  public:
+    Adafruit_NeoPixel(uint16_t n, int16_t pin = 6,
+                      neoPixelType type = NEO_GRB + NEO_KHZ800);
+    Adafruit_NeoPixel(void);
+    ~Adafruit_NeoPixel();
+
+    void begin(void) { begun = true; }
+    void show(void);
+    void clear(void);
+    void setPin(int16_t p) { pin = p; }
+    void updateLength(uint16_t n);
+    void updateType(neoPixelType t);
+    void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b);
+    void setBrightness(uint8_t b) { brightness = b + 1; }
+    uint8_t getBrightness(void) const { return brightness - 1; }
+    uint8_t *getPixels(void) const { return pixels; }
+    uint16_t numPixels(void) const { return numLEDs; }
+    int16_t getPin(void) const { return pin; }
+    bool canShow(void) const { return true; }
+
+    // Number of show() calls, used by the host benchmarks.
+    uint32_t getShowCount(void) const { return showCount; }
+
+  protected:
+    bool begun;
+    uint16_t numLEDs;
+    uint16_t numBytes;
+    int16_t pin;
+    uint8_t brightness;
+    uint8_t *pixels;
+    uint8_t rOffset;
+    uint8_t gOffset;
+    uint8_t bOffset;
+    uint8_t wOffset;
+    uint32_t showCount;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef __ARDUINO_SHIM_H__
+#define __ARDUINO_SHIM_H__
+
+// Host stand-in for the Arduino core: timing, GPIO stubs and a Serial that
+// writes to stdout. FdStream in fd_stream.h reads a file descriptor such as a
+// pty through the same Stream interface.
+
+#include <functional>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#define LOW 0x0
+#define HIGH 0x1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t val);
+
+// Subset of the Arduino Stream used by the firmware
+class Stream {
+  public:
+    virtual ~Stream() {}
+    virtual int available(void) = 0;
+    virtual int read(void) = 0;
+    // Waits for length bytes on the ESP32, only ask for available() bytes
+    virtual size_t readBytes(uint8_t *buffer, size_t length) = 0;
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *data, size_t len) = 0;
+};
+
+class HardwareSerial : public Stream {
+  public:
+    void begin(unsigned long baud) { (void)baud; }
+    // Nothing is ever received, the callback is never called
+    void onReceive(std::function<void(void)> function,
+                   bool only_on_timeout = false) {
+        (void)function;
+        (void)only_on_timeout;
+    }
+    size_t setRxBufferSize(size_t size) { return size; }
+    int available(void) { return 0; }
+    int read(void) { return -1; }
+    size_t readBytes(uint8_t *buffer, size_t length) {
+        (void)buffer;
+        (void)length;
+        return 0;
+    }
+    size_t write(uint8_t c) { return fwrite(&c, 1, 1, stdout); }
+    size_t write(const uint8_t *data, size_t len) {
+        return fwrite(data, 1, len, stdout);
+    }
+    size_t printf(const char *format, ...)
+        __attribute__((format(printf, 2, 3)));
+    void flush(void) { fflush(stdout); }
+};
+
+extern HardwareSerial Serial;
+
+#endif
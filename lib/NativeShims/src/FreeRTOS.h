@@ -0,0 +1,29 @@
+#ifndef __FREERTOS_SHIM_H__
+#define __FREERTOS_SHIM_H__
+
+// Host stand-in for the FreeRTOS kernel API used by the LED pipeline. Tasks
+// run as std::threads and the tick runs at 1 kHz from the monotonic clock.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS (pdTRUE)
+#define pdFAIL (pdFALSE)
+
+#define configTICK_RATE_HZ 1000
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)                                                      \
+    ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) /       \
+                  (TickType_t)1000U))
+
+#define tskIDLE_PRIORITY ((UBaseType_t)0U)
+#define tskNO_AFFINITY ((BaseType_t)0x7FFFFFFF)
+
+#endif
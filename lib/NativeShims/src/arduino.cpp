@@ -0,0 +1,46 @@
+#include "Arduino.h"
+#include "esp_timer.h"
+
+#include <chrono>
+#include <stdarg.h>
+#include <thread>
+
+HardwareSerial Serial;
+
+// Same time base as the ESP32 core, both count from esp_timer_get_time()
+unsigned long millis(void) {
+    return (unsigned long)(esp_timer_get_time() / 1000);
+}
+
+unsigned long micros(void) { return (unsigned long)esp_timer_get_time(); }
+
+void delay(uint32_t ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    (void)pin;
+    (void)mode;
+}
+
+int digitalRead(uint8_t pin) {
+    (void)pin;
+    return HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+    (void)pin;
+    (void)val;
+}
+
+size_t HardwareSerial::printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = vprintf(format, args);
+    va_end(args);
+    return len < 0 ? 0 : (size_t)len;
+}
@@ -0,0 +1,98 @@
+#include "esp_timer.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+typedef std::chrono::steady_clock Clock;
+
+struct NativeTimer {
+    esp_timer_cb_t callback;
+    void *arg;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool armed = false;
+    bool deleted = false;
+    Clock::time_point deadline;
+};
+
+static Clock::time_point boot_time(void) {
+    static const Clock::time_point boot = Clock::now();
+    return boot;
+}
+
+static void timer_thread(NativeTimer *timer) {
+    std::unique_lock<std::mutex> lock(timer->mutex);
+    while (!timer->deleted) {
+        if (!timer->armed) {
+            timer->cond.wait(lock);
+            continue;
+        }
+        if (timer->cond.wait_until(lock, timer->deadline) ==
+                std::cv_status::timeout &&
+            timer->armed && Clock::now() >= timer->deadline) {
+            timer->armed = false;
+            lock.unlock();
+            timer->callback(timer->arg);
+            lock.lock();
+        }
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args,
+                           esp_timer_handle_t *out_handle) {
+    if (create_args == nullptr || create_args->callback == nullptr ||
+        out_handle == nullptr) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    NativeTimer *timer = new NativeTimer();
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->thread = std::thread(timer_thread, timer);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    {
+        std::lock_guard<std::mutex> lock(timer->mutex);
+        if (timer->armed) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        timer->armed = true;
+        timer->deadline = Clock::now() + std::chrono::microseconds(timeout_us);
+    }
+    timer->cond.notify_one();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    {
+        std::lock_guard<std::mutex> lock(timer->mutex);
+        if (!timer->armed) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        timer->armed = false;
+    }
+    timer->cond.notify_one();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    {
+        std::lock_guard<std::mutex> lock(timer->mutex);
+        timer->deleted = true;
+    }
+    timer->cond.notify_one();
+    timer->thread.join();
+    delete timer;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time(void) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               Clock::now() - boot_time())
+        .count();
+}
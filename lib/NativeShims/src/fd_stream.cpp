@@ -0,0 +1,51 @@
+#include "fd_stream.h"
+
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+int FdStream::available(void) {
+    int count = 0;
+    if (ioctl(m_fd, FIONREAD, &count) != 0) {
+        return 0;
+    }
+    return count;
+}
+
+int FdStream::read(void) {
+    uint8_t c;
+    return readBytes(&c, 1) == 1 ? c : -1;
+}
+
+size_t FdStream::readBytes(uint8_t *buffer, size_t length) {
+    if (length == 0 || available() == 0) {
+        return 0;
+    }
+    ssize_t len = ::read(m_fd, buffer, length);
+    return len < 0 ? 0 : (size_t)len;
+}
+
+size_t FdStream::write(const uint8_t *data, size_t len) {
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = ::write(m_fd, data + written, len - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        written += n;
+    }
+    return written;
+}
+
+bool SetRawMode(int fd) {
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        return false;
+    }
+    cfmakeraw(&tio);
+    return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
@@ -0,0 +1,27 @@
+#ifndef __FD_STREAM_SHIM_H__
+#define __FD_STREAM_SHIM_H__
+
+#include "Arduino.h"
+
+/**
+ * Stream over a file descriptor, e.g. the slave side of a pty standing in for
+ * the USB serial port. Reads never block. The descriptor is not closed.
+ */
+class FdStream : public Stream {
+  public:
+    FdStream(int fd) : m_fd(fd) {}
+
+    int available(void);
+    int read(void);
+    size_t readBytes(uint8_t *buffer, size_t length);
+    size_t write(uint8_t c) { return write(&c, 1); }
+    size_t write(const uint8_t *data, size_t len);
+
+  private:
+    int m_fd;
+};
+
+// Switch a tty to raw 8 bit mode, false if fd is not a tty
+bool SetRawMode(int fd);
+
+#endif
@@ -0,0 +1,160 @@
+#include "FreeRTOS.h"
+#include "esp_timer.h"
+#include "semphr.h"
+#include "task.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+/******************************************************************************
+ * Tasks
+ ******************************************************************************/
+struct NativeTask {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+    uint32_t notify_value = 0;
+    uint32_t stack_depth = 0;
+    // Set once the task deleted itself, the handle must not be used anymore
+    std::atomic<bool> deleted{false};
+};
+
+// Threads not created through xTaskCreatePinnedToCore get a handle on demand
+static thread_local NativeTask *current_task = nullptr;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char *name,
+                                   uint32_t stack_depth, void *params,
+                                   UBaseType_t priority,
+                                   TaskHandle_t *created_task,
+                                   BaseType_t core_id) {
+    (void)name;
+    (void)priority;
+    (void)core_id;
+    NativeTask *handle = new NativeTask();
+    handle->stack_depth = stack_depth;
+    handle->thread = std::thread([task, params, handle]() {
+        current_task = handle;
+        task(params);
+    });
+    if (created_task != nullptr) {
+        *created_task = handle;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    // A task deleting itself just returns and lets its thread end, the handle
+    // is kept so late notifications are caught instead of corrupting memory
+    if (task == nullptr || task == current_task) {
+        xTaskGetCurrentTaskHandle()->deleted = true;
+    } else {
+        if (task->thread.joinable()) {
+            task->thread.join();
+        }
+        delete task;
+    }
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(esp_timer_get_time() / (1000 * portTICK_PERIOD_MS));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (current_task == nullptr) {
+        current_task = new NativeTask();
+    }
+    return current_task;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    if (task == nullptr) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    return task->stack_depth;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    if (task->deleted) {
+        fprintf(stderr, "xTaskNotifyGive: task %p was deleted\n", task);
+        abort();
+    }
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notify_value++;
+    }
+    task->cond.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    NativeTask *task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    if (ticks == portMAX_DELAY) {
+        task->cond.wait(lock, [task] { return task->notify_value > 0; });
+    } else {
+        task->cond.wait_for(lock, std::chrono::milliseconds(ticks),
+                            [task] { return task->notify_value > 0; });
+    }
+    uint32_t value = task->notify_value;
+    if (value > 0) {
+        task->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    return value;
+}
+
+/******************************************************************************
+ * Semaphores
+ ******************************************************************************/
+struct NativeSemaphore {
+    std::mutex mutex;
+    std::condition_variable cond;
+    uint32_t count;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    NativeSemaphore *sem = new NativeSemaphore();
+    sem->count = 1;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    NativeSemaphore *sem = new NativeSemaphore();
+    sem->count = 0;
+    return sem;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) { delete semaphore; }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    std::unique_lock<std::mutex> lock(semaphore->mutex);
+    if (ticks == portMAX_DELAY) {
+        semaphore->cond.wait(lock, [semaphore] { return semaphore->count > 0; });
+    } else if (!semaphore->cond.wait_for(
+                   lock, std::chrono::milliseconds(ticks),
+                   [semaphore] { return semaphore->count > 0; })) {
+        return pdFALSE;
+    }
+    semaphore->count--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    {
+        std::lock_guard<std::mutex> lock(semaphore->mutex);
+        if (semaphore->count > 0) {
+            return pdFALSE;
+        }
+        semaphore->count++;
+    }
+    semaphore->cond.notify_one();
+    return pdTRUE;
+}
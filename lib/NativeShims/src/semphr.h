@@ -0,0 +1,17 @@
+#ifndef __SEMPHR_SHIM_H__
+#define __SEMPHR_SHIM_H__
+
+// Like the real header, this pulls in the task API through queue.h.
+#include "FreeRTOS.h"
+#include "task.h"
+
+struct NativeSemaphore;
+typedef NativeSemaphore *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+
+#endif
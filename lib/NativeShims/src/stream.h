@@ -0,0 +1,6 @@
+#ifndef __STREAM_SHIM_H__
+#define __STREAM_SHIM_H__
+
+#include "Arduino.h"
+
+#endif
@@ -0,0 +1,240 @@
+#include "arena.h"
+#include <Arduino.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(ESP_PLATFORM)
+#include <esp_heap_caps.h>
+#endif
+
+#define ARENA_ALIGN 8
+// Every block starts with its size, padded to keep the data aligned
+#define ARENA_HEADER ARENA_ALIGN
+
+#if LED_ARENA_HOT_SIZE > 0
+static uint8_t s_hot_buffer[LED_ARENA_HOT_SIZE]
+    __attribute__((aligned(ARENA_ALIGN)));
+#endif
+
+static Arena *s_hot = nullptr;
+static Arena *s_cold = nullptr;
+static TaskHandle_t s_scope_task = nullptr;
+static bool s_scope_open = false;
+
+static size_t align_up(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static size_t block_size(const void *ptr) {
+    return *(const size_t *)((const uint8_t *)ptr - ARENA_HEADER);
+}
+
+/******************************************************************************
+ * Arena
+ ******************************************************************************/
+Arena::Arena(const char *name, uint8_t *buffer, size_t size)
+    : m_name(name), m_buffer(buffer), m_size(buffer != nullptr ? size : 0),
+      m_used(0), m_last(0), m_has_last(false), m_allocations(0),
+      m_fallbacks(0) {}
+
+void *Arena::allocate(size_t size) {
+    size_t need = ARENA_HEADER + align_up(size);
+    if (m_size - m_used < need) {
+        return nullptr;
+    }
+    uint8_t *block = m_buffer + m_used;
+    *(size_t *)block = size;
+    m_last = m_used;
+    m_has_last = true;
+    m_used += need;
+    m_allocations++;
+    return block + ARENA_HEADER;
+}
+
+void *Arena::reallocate(void *ptr, size_t size) {
+    if (ptr == nullptr) {
+        return allocate(size);
+    }
+    uint8_t *block = (uint8_t *)ptr - ARENA_HEADER;
+    if (m_has_last && block == m_buffer + m_last) {
+        size_t end = m_last + ARENA_HEADER + align_up(size);
+        if (m_size < end) {
+            return nullptr;
+        }
+        *(size_t *)block = size;
+        m_used = end;
+        return ptr;
+    }
+    size_t old_size = block_size(ptr);
+    void *moved = allocate(size);
+    if (moved != nullptr) {
+        memcpy(moved, ptr, old_size < size ? old_size : size);
+    }
+    return moved;
+}
+
+void Arena::release(void *ptr) {
+    uint8_t *block = (uint8_t *)ptr - ARENA_HEADER;
+    if (m_has_last && block == m_buffer + m_last) {
+        m_used = m_last;
+        m_has_last = false;
+        m_allocations--;
+    }
+}
+
+Arena *Arena::hot(void) {
+#if LED_ARENA_HOT_SIZE > 0
+    static Arena arena("hot", s_hot_buffer, sizeof(s_hot_buffer));
+    return &arena;
+#else
+    return nullptr;
+#endif
+}
+
+Arena *Arena::cold(void) {
+#if LED_ARENA_COLD_SIZE > 0
+    static Arena *arena = nullptr;
+    if (arena == nullptr) {
+        uint8_t *buffer = nullptr;
+#if defined(ESP_PLATFORM)
+        buffer = (uint8_t *)heap_caps_malloc(
+            LED_ARENA_COLD_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#endif
+        if (buffer == nullptr) {
+            buffer = (uint8_t *)malloc(LED_ARENA_COLD_SIZE);
+        }
+        arena = new Arena("cold", buffer, LED_ARENA_COLD_SIZE);
+    }
+    return arena;
+#else
+    return nullptr;
+#endif
+}
+
+/******************************************************************************
+ * ArenaScope
+ ******************************************************************************/
+ArenaScope::ArenaScope(void) {
+    s_hot = Arena::hot();
+    s_cold = Arena::cold();
+    s_scope_task = xTaskGetCurrentTaskHandle();
+    s_scope_open = true;
+}
+
+ArenaScope::~ArenaScope() { s_scope_open = false; }
+
+/******************************************************************************
+ * Allocation entry points
+ ******************************************************************************/
+// Arena serving region for the calling task, nullptr outside a scope
+static Arena *scope_arena(MemoryRegion region) {
+    if (!s_scope_open || xTaskGetCurrentTaskHandle() != s_scope_task) {
+        return nullptr;
+    }
+    return region == MEMORY_HOT ? s_hot : s_cold;
+}
+
+static Arena *owner_of(const void *ptr) {
+    if (s_hot != nullptr && s_hot->owns(ptr)) {
+        return s_hot;
+    }
+    if (s_cold != nullptr && s_cold->owns(ptr)) {
+        return s_cold;
+    }
+    return nullptr;
+}
+
+static void *heap_malloc(size_t size, MemoryRegion region) {
+#if defined(ESP_PLATFORM)
+    if (region == MEMORY_HOT) {
+        void *ptr =
+            heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (ptr != nullptr) {
+            return ptr;
+        }
+    }
+#else
+    (void)region;
+#endif
+    return malloc(size);
+}
+
+void *led_malloc(size_t size, MemoryRegion region) {
+    Arena *arena = scope_arena(region);
+    if (arena != nullptr) {
+        void *ptr = arena->allocate(size);
+        if (ptr != nullptr) {
+            return ptr;
+        }
+        arena->addFallback();
+    }
+    return heap_malloc(size, region);
+}
+
+void *led_calloc(size_t count, size_t size, MemoryRegion region) {
+    void *ptr = led_malloc(count * size, region);
+    if (ptr != nullptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void *led_realloc(void *ptr, size_t size, MemoryRegion region) {
+    if (ptr == nullptr) {
+        return led_malloc(size, region);
+    }
+    Arena *owner = owner_of(ptr);
+    if (owner == nullptr) {
+        return realloc(ptr, size);
+    }
+    if (scope_arena(region) != nullptr) {
+        void *moved = owner->reallocate(ptr, size);
+        if (moved != nullptr) {
+            return moved;
+        }
+        owner->addFallback();
+    }
+    // Arena blocks only grow inside a scope, otherwise they move to the heap
+    // and the old block stays unused
+    void *moved = heap_malloc(size, region);
+    if (moved != nullptr) {
+        size_t old_size = block_size(ptr);
+        memcpy(moved, ptr, old_size < size ? old_size : size);
+    }
+    return moved;
+}
+
+void led_free(void *ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    Arena *owner = owner_of(ptr);
+    if (owner == nullptr) {
+        free(ptr);
+    } else {
+        owner->release(ptr);
+    }
+}
+
+void led_memory_report(void) {
+    Arena *arenas[] = {s_hot, s_cold};
+    for (size_t i = 0; i < sizeof(arenas) / sizeof(arenas[0]); i++) {
+        Arena *arena = arenas[i];
+        if (arena == nullptr) {
+            continue;
+        }
+        Serial.printf("%s arena: %u of %u bytes used in %u blocks, %u blocks "
+                      "on the heap\n",
+                      arena->getName(), (unsigned)arena->getUsed(),
+                      (unsigned)arena->getSize(),
+                      (unsigned)arena->getAllocations(),
+                      (unsigned)arena->getFallbacks());
+    }
+#if defined(ESP_PLATFORM)
+    Serial.printf("heap: %u internal bytes free, largest block %u, %u psram "
+                  "bytes free\n",
+                  (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+                  (unsigned)heap_caps_get_largest_free_block(
+                      MALLOC_CAP_INTERNAL),
+                  (unsigned)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+#endif
+}
@@ -0,0 +1,89 @@
+#include "color_kernels.h"
+#include "color_swar.h"
+
+// Color is a single packed word, the kernels work on the words directly
+#define PACKED(colors) ((uint32_t *)(colors))
+#define CONST_PACKED(colors) ((const uint32_t *)(colors))
+
+/******************************************************************************
+ * Span kernels
+ ******************************************************************************/
+void color_scale(Color *colors, size_t count, uint8_t scale) {
+    uint32_t *pixels = PACKED(colors);
+    uint32_t factor = swar_factor(scale);
+    for (size_t i = 0; i < count; i++) {
+        pixels[i] = swar_scale(pixels[i], factor);
+    }
+}
+
+void color_add(Color *colors, const Color *other, size_t count) {
+    uint32_t *pixels = PACKED(colors);
+    const uint32_t *values = CONST_PACKED(other);
+    for (size_t i = 0; i < count; i++) {
+        pixels[i] = swar_add(pixels[i], values[i]);
+    }
+}
+
+void color_add(Color *colors, size_t count, const Color &color) {
+    uint32_t *pixels = PACKED(colors);
+    uint32_t value = color.Value();
+    for (size_t i = 0; i < count; i++) {
+        pixels[i] = swar_add(pixels[i], value);
+    }
+}
+
+void color_sub(Color *colors, const Color *other, size_t count) {
+    uint32_t *pixels = PACKED(colors);
+    const uint32_t *values = CONST_PACKED(other);
+    for (size_t i = 0; i < count; i++) {
+        pixels[i] = swar_sub(pixels[i], values[i]);
+    }
+}
+
+void color_sub(Color *colors, size_t count, const Color &color) {
+    uint32_t *pixels = PACKED(colors);
+    uint32_t value = color.Value();
+    for (size_t i = 0; i < count; i++) {
+        pixels[i] = swar_sub(pixels[i], value);
+    }
+}
+
+// Channel of pixel times factor / 255, rounded. factor is the channel of the
+// color times 257, which turns the division into a shift with the same result
+#define MUL_CHANNEL(pixel, factor, shift)                                      \
+    (((((pixel) >> (shift)) & 0xff) * (factor) + 0x8080) >> 16 << (shift))
+
+void color_multiply(Color *colors, size_t count, const Color &color) {
+    uint32_t *pixels = PACKED(colors);
+    uint32_t value = color.Value();
+    uint32_t b = (value & 0xff) * 257;
+    uint32_t g = ((value >> 8) & 0xff) * 257;
+    uint32_t r = ((value >> 16) & 0xff) * 257;
+    uint32_t w = (value >> 24) * 257;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t pixel = pixels[i];
+        pixels[i] = MUL_CHANNEL(pixel, b, 0) | MUL_CHANNEL(pixel, g, 8) |
+                    MUL_CHANNEL(pixel, r, 16) | MUL_CHANNEL(pixel, w, 24);
+    }
+}
+
+void color_fade(Color *colors, size_t count, const Color &target,
+                uint8_t amount) {
+    uint32_t *pixels = PACKED(colors);
+    uint32_t value = target.Value();
+    uint32_t factor = swar_factor(amount);
+    for (size_t i = 0; i < count; i++) {
+        pixels[i] = swar_lerp(pixels[i], value, factor);
+    }
+}
+
+void color_lerp(Color *colors, const Color *from, const Color *to,
+                size_t count, uint8_t amount) {
+    uint32_t *pixels = PACKED(colors);
+    const uint32_t *start = CONST_PACKED(from);
+    const uint32_t *end = CONST_PACKED(to);
+    uint32_t factor = swar_factor(amount);
+    for (size_t i = 0; i < count; i++) {
+        pixels[i] = swar_lerp(start[i], end[i], factor);
+    }
+}
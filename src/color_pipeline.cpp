@@ -0,0 +1,109 @@
+#include "color_pipeline.h"
+#include <math.h>
+
+// Full scale of the 8.8 curve, 255 in the integer part
+#define CURVE_MAX (255 << 8)
+
+/******************************************************************************
+ * ColorPipeline
+ ******************************************************************************/
+ColorPipeline::ColorPipeline()
+    : m_brightness(255), m_gamma(1.0f), m_white_point(Color::WHITE),
+      m_dithering(false), m_generation(1), m_built_generation(0),
+      m_built_gamma(0.0f) {}
+
+void ColorPipeline::setBrightness(uint8_t brightness) {
+    m_brightness = brightness;
+    changed();
+}
+
+void ColorPipeline::setGamma(float gamma) {
+    m_gamma = gamma > 0.0f ? gamma : 1.0f;
+    changed();
+}
+
+void ColorPipeline::setWhitePoint(const Color &white) {
+    m_white_point = white;
+    changed();
+}
+
+void ColorPipeline::setDithering(bool enable) {
+    m_dithering = enable;
+    changed();
+}
+
+void ColorPipeline::changed(void) {
+    m_generation.fetch_add(1, std::memory_order_release);
+}
+
+bool ColorPipeline::isIdentity(void) const {
+    return m_brightness == 255 && m_gamma == 1.0f && !m_dithering &&
+           (m_white_point.Value() & 0xffffff) == 0xffffff;
+}
+
+void ColorPipeline::rebuild(void) {
+    if (m_built_gamma != m_gamma) {
+        m_built_gamma = m_gamma;
+        for (uint32_t i = 0; i < 256; i++) {
+            m_curve[i] =
+                (uint16_t)(powf(i / 255.0f, m_built_gamma) * CURVE_MAX + 0.5f);
+        }
+    }
+    // Brightness times the white point of every channel, 255 * 255 is full
+    // scale. The white LED has no white point to correct.
+    uint32_t scale[4];
+    scale[CHANNEL_RED] = m_white_point.R() * (uint32_t)m_brightness;
+    scale[CHANNEL_GREEN] = m_white_point.G() * (uint32_t)m_brightness;
+    scale[CHANNEL_BLUE] = m_white_point.B() * (uint32_t)m_brightness;
+    scale[CHANNEL_WHITE] = 255 * (uint32_t)m_brightness;
+    for (uint32_t channel = 0; channel < 4; channel++) {
+        for (uint32_t i = 0; i < 256; i++) {
+            // Fits 32 bits, CURVE_MAX * 255 * 255 < 2^32
+            uint32_t fine = (m_curve[i] * scale[channel] + 255 * 255 / 2) /
+                            (255 * 255);
+            m_fine[channel][i] = (uint16_t)fine;
+            m_table[channel][i] = (uint8_t)((fine + 0x80) >> 8);
+        }
+    }
+}
+
+void ColorPipeline::apply(const uint8_t *src, uint8_t *dst, size_t len,
+                          const uint8_t *channels, uint8_t stride,
+                          uint8_t *error) {
+    uint32_t generation = m_generation.load(std::memory_order_acquire);
+    if (generation != m_built_generation) {
+        m_built_generation = generation;
+        rebuild();
+    }
+    if (m_dithering) {
+        const uint16_t *fine[4];
+        for (uint8_t i = 0; i < stride; i++) {
+            fine[i] = m_fine[channels[i]];
+        }
+        for (size_t i = 0; i < len; i += stride) {
+            for (uint8_t k = 0; k < stride; k++) {
+                uint32_t value = fine[k][src[i + k]] + error[i + k];
+                dst[i + k] = (uint8_t)(value >> 8);
+                error[i + k] = (uint8_t)value;
+            }
+        }
+        return;
+    }
+    const uint8_t *table[4];
+    for (uint8_t i = 0; i < stride; i++) {
+        table[i] = m_table[channels[i]];
+    }
+    if (stride == 3) {
+        for (size_t i = 0; i + 3 <= len; i += 3) {
+            dst[i] = table[0][src[i]];
+            dst[i + 1] = table[1][src[i + 1]];
+            dst[i + 2] = table[2][src[i + 2]];
+        }
+        return;
+    }
+    for (size_t i = 0; i < len; i += stride) {
+        for (uint8_t k = 0; k < stride; k++) {
+            dst[i + k] = table[k][src[i + k]];
+        }
+    }
+}
@@ -0,0 +1,164 @@
+#include "compositor.h"
+#include "color_swar.h"
+
+/******************************************************************************
+ * Blend kernels
+ ******************************************************************************/
+template <uint32_t (*Blend)(uint32_t, uint32_t)>
+static void blend_span(uint32_t *dst, const uint32_t *src, size_t count,
+                       uint8_t opacity) {
+    if (opacity == 0xff) {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = Blend(dst[i], src[i]);
+        }
+    } else {
+        uint32_t factor = swar_factor(opacity);
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = swar_lerp(dst[i], Blend(dst[i], src[i]), factor);
+        }
+    }
+}
+
+static void blend_layer(BlendMode mode, uint32_t *dst, const uint32_t *src,
+                        size_t count, uint8_t opacity) {
+    if (opacity == 0) {
+        return;
+    }
+    switch (mode) {
+    case BLEND_ADD:
+        blend_span<swar_add>(dst, src, count, opacity);
+        break;
+    case BLEND_MULTIPLY:
+        blend_span<swar_mul>(dst, src, count, opacity);
+        break;
+    case BLEND_SCREEN:
+        blend_span<swar_screen>(dst, src, count, opacity);
+        break;
+    case BLEND_MAX:
+        blend_span<swar_max>(dst, src, count, opacity);
+        break;
+    case BLEND_ALPHA:
+        blend_span<swar_over>(dst, src, count, opacity);
+        break;
+    }
+}
+
+// Blend onto black, the bottom layer is written in one pass instead of
+// clearing the frame and blending it
+static void blend_first_layer(BlendMode mode, uint32_t *dst,
+                              const uint32_t *src, size_t count,
+                              uint8_t opacity) {
+    if (mode == BLEND_MULTIPLY || opacity == 0) {
+        memset(dst, 0, sizeof(uint32_t) * count);
+    } else if (opacity == 0xff) {
+        memcpy(dst, src, sizeof(uint32_t) * count);
+    } else {
+        uint32_t factor = swar_factor(opacity);
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = swar_scale(src[i], factor);
+        }
+    }
+}
+
+/******************************************************************************
+ * LedLayer
+ ******************************************************************************/
+LedLayer::LedLayer(uint16_t num_pixels, BlendMode mode, uint8_t opacity)
+    : m_num_pixels(num_pixels), m_effect(nullptr), m_mode(mode),
+      m_opacity(opacity) {}
+
+LedLayer::~LedLayer() {
+    if (m_effect != nullptr) {
+        delete m_effect;
+    }
+}
+
+void LedLayer::setEffect(EffectBase *effect) {
+    if (m_effect != nullptr) {
+        delete m_effect;
+    }
+    m_effect = effect;
+}
+
+LedsSpan LedLayer::getPixels(void) {
+    if (m_effect == nullptr) {
+        return LedsSpan();
+    }
+    return m_effect->getPixels();
+}
+
+void LedLayer::updateSegment(LedsSpan leds, size_t start, size_t end) {
+    if (m_effect == nullptr) {
+        return;
+    }
+    LedsList &pixels = m_effect->getPixels();
+    if (pixels.count() < end) {
+        end = pixels.count();
+    }
+    // The effect writing its own buffer back is the common case
+    if (start < end && leds.data() != pixels.data() + start) {
+        memcpy((void *)(pixels.data() + start), (const void *)leds.data(),
+               sizeof(::Color) * (end - start));
+    }
+}
+
+void LedLayer::updatePixels(LedsSpan leds) {
+    updateSegment(leds, 0, leds.count());
+}
+
+void LedLayer::updatePixel(uint16_t index, ::Color color) {
+    if (m_effect == nullptr) {
+        return;
+    }
+    LedsList &pixels = m_effect->getPixels();
+    if (index < pixels.count()) {
+        pixels[index] = color;
+    }
+}
+
+/******************************************************************************
+ * Compositor
+ ******************************************************************************/
+Compositor::Compositor(ILedStrip *led_strip, size_t max_layers)
+    : EffectBase(led_strip, Palette(1, Color::BLACK, Color::WHITE)),
+      m_layers() {
+    m_layers.resize(max_layers);
+}
+
+Compositor::~Compositor() {
+    for (size_t i = 0; i < m_layers.count(); i++) {
+        delete m_layers[i];
+    }
+}
+
+LedLayer *Compositor::addLayer(BlendMode mode, uint8_t opacity) {
+    LedLayer *layer = new LedLayer(m_leds.count(), mode, opacity);
+    m_layers.add(layer);
+    return layer;
+}
+
+void Compositor::update(uint32_t dt_us) {
+    uint32_t *dst = (uint32_t *)this->m_leds.data();
+    size_t count = this->m_leds.count();
+    bool first = true;
+    for (size_t i = 0; i < this->m_layers.count(); i++) {
+        LedLayer *layer = this->m_layers[i];
+        if (layer->getEffect() == nullptr) {
+            continue;
+        }
+        layer->getEffect()->update(dt_us);
+        const uint32_t *src = (const uint32_t *)layer->getPixels().data();
+        if (first) {
+            blend_first_layer(layer->getMode(), dst, src, count,
+                              layer->getOpacity());
+            first = false;
+        } else {
+            blend_layer(layer->getMode(), dst, src, count,
+                        layer->getOpacity());
+        }
+    }
+    if (first) {
+        memset(dst, 0, sizeof(uint32_t) * count);
+    }
+    EffectBase::update(dt_us);
+}
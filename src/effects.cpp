@@ -6,8 +6,11 @@
  ******************************************************************************/
 EffectsManager::EffectsManager(uint32_t num_of_effects, uint32_t refresh_rate,
                                BaseType_t core)
-    : ITaskManager(refresh_rate, core), m_effects() {
+    : ITaskManager(refresh_rate, core), m_effects(), m_rendered_at(),
+      m_frame_us(0), m_workers(), m_num_workers(0), m_workers_core(0),
+      m_workers_stop(false), m_jobs(), m_next_job(0) {
     m_effects.resize(num_of_effects);
+    m_rendered_at.resize(num_of_effects);
 }
 
 EffectsManager::~EffectsManager() {
@@ -19,16 +22,149 @@ EffectsManager::~EffectsManager() {
     }
 }
 
-void EffectsManager::AddEffect(EffectBase *effect) { m_effects.add(effect); }
+bool EffectsManager::AddEffect(EffectBase *effect) {
+    // Grow both lists before adding, so the adds can not fail and the lists
+    // never differ in length. Effects past num_of_effects grow the lists
+    // geometrically, every move leaves a dead block in the arena.
+    size_t count = m_effects.count() + 1;
+    if (!m_effects.reserve(count) || !m_rendered_at.reserve(count)) {
+        return false;
+    }
+    m_effects.add(effect);
+    m_rendered_at.add(-1);
+    return true;
+}
+
+void EffectsManager::setup() {
+    this->m_workers_stop = false;
+    for (uint32_t i = 0; i < this->m_num_workers; i++) {
+        RenderWorker worker;
+        worker.manager = this;
+        worker.start = xSemaphoreCreateBinary();
+        worker.done = xSemaphoreCreateBinary();
+        worker.task = nullptr;
+        this->m_workers.add(worker);
+    }
+    // Tasks keep a pointer to their worker, so only start them once the
+    // list stopped growing
+    for (size_t i = 0; i < this->m_workers.count(); i++) {
+        RenderWorker &worker = this->m_workers[i];
+        xTaskCreatePinnedToCore(EffectsManager::RenderWorkerTask,
+                                "RenderWorker", this->m_stack_size, &worker,
+                                this->m_priority, &worker.task,
+                                this->m_workers_core);
+    }
+}
 
-void EffectsManager::setup() {}
 void EffectsManager::update() {
-    for (int i = 0; i < this->m_effects.count(); i++) {
+    this->renderFrame(0, this->m_effects.count());
+}
+
+void EffectsManager::renderFrame(uint32_t first, uint32_t last) {
+    this->beginFrame();
+    this->m_jobs.clear();
+    uint32_t frame_pixels = 0;
+    for (uint32_t i = first; i < last; i++) {
+        frame_pixels += this->m_effects[i]->getNumPixels();
+    }
+    // Smaller frames render faster than the workers wake up
+    bool shared = this->m_workers.count() > 0 &&
+                  frame_pixels >= 2 * EFFECTS_RENDER_CHUNK;
+    for (uint32_t i = first; i < last; i++) {
         EffectBase *effect = this->m_effects[i];
-        effect->update();
+        uint32_t pixels = effect->getNumPixels();
+        uint32_t chunks = pixels / EFFECTS_RENDER_CHUNK;
+        if (!shared || !effect->isSplit() || chunks < 2) {
+            this->m_jobs.add(RenderJob{i, 0, 0});
+            continue;
+        }
+        effect->step(this->frameStep(i));
+        for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+            this->m_jobs.add(RenderJob{i, (uint16_t)(pixels * chunk / chunks),
+                                       (uint16_t)(pixels * (chunk + 1) /
+                                                  chunks)});
+        }
+    }
+    this->m_next_job.store(0);
+    uint32_t helpers =
+        shared && this->m_jobs.count() > 1 ? this->m_workers.count() : 0;
+    for (uint32_t i = 0; i < helpers; i++) {
+        xSemaphoreGive(this->m_workers[i].start);
+    }
+    this->renderJobs();
+    // Barrier, the frame is complete once every worker is done
+    for (uint32_t i = 0; i < helpers; i++) {
+        xSemaphoreTake(this->m_workers[i].done, portMAX_DELAY);
+    }
+    for (uint32_t i = first; i < last; i++) {
+        this->m_effects[i]->publish();
+    }
+}
+
+void EffectsManager::cleanup() {
+    this->m_workers_stop = true;
+    for (size_t i = 0; i < this->m_workers.count(); i++) {
+        xSemaphoreGive(this->m_workers[i].start);
+    }
+    for (size_t i = 0; i < this->m_workers.count(); i++) {
+        RenderWorker &worker = this->m_workers[i];
+        xSemaphoreTake(worker.done, portMAX_DELAY);
+        vSemaphoreDelete(worker.start);
+        vSemaphoreDelete(worker.done);
     }
+    this->m_workers = ArrayList<RenderWorker>();
+}
+
+void EffectsManager::renderJobs(void) {
+    uint32_t count = this->m_jobs.count();
+    uint32_t index;
+    while ((index = this->m_next_job.fetch_add(1)) < count) {
+        const RenderJob &job = this->m_jobs[index];
+        if (job.last == 0) {
+            this->renderEffect(job.index);
+        } else {
+            this->m_effects[job.index]->render(job.first, job.last);
+        }
+    }
+}
+
+void EffectsManager::beginFrame(void) {
+    this->m_frame_us = this->isRunning() ? this->m_scheduler.getDeadline()
+                                         : esp_timer_get_time();
+}
+
+uint32_t EffectsManager::frameStep(uint32_t index) {
+    int64_t last = this->m_rendered_at[index];
+    int64_t dt = this->m_frame_us - last;
+    if (last < 0 || dt < 0) {
+        // First frame, one frame period or one tick without a rate
+        dt = this->m_refresh_rate > 0 ? 1000000 / this->m_refresh_rate
+                                      : EFFECT_TICK_US;
+    } else if (dt > EFFECT_MAX_STEP_US) {
+        dt = EFFECT_MAX_STEP_US;
+    }
+    this->m_rendered_at[index] = this->m_frame_us;
+    return (uint32_t)dt;
+}
+
+void EffectsManager::renderEffect(uint32_t index) {
+    this->m_effects[index]->update(this->frameStep(index));
+}
+
+void EffectsManager::RenderWorkerTask(void *ctx) {
+    RenderWorker *worker = (RenderWorker *)ctx;
+    EffectsManager *manager = worker->manager;
+    while (true) {
+        xSemaphoreTake(worker->start, portMAX_DELAY);
+        if (manager->m_workers_stop) {
+            break;
+        }
+        manager->renderJobs();
+        xSemaphoreGive(worker->done);
+    }
+    xSemaphoreGive(worker->done);
+    vTaskDelete(nullptr);
 }
-void EffectsManager::cleanup() {}
 
 /******************************************************************************
  * Effectmanager
@@ -44,7 +180,7 @@ EffectManager::EffectManager(EffectBase *effect, uint32_t refresh_rate,
 
 void EffectManager::update(void) {
     if (this->m_active < this->m_effects.count()) {
-        this->m_effects[this->m_active]->update();
+        this->renderFrame(this->m_active, this->m_active + 1);
     }
 }
 
@@ -53,119 +189,202 @@ void EffectManager::setActive(uint32_t index) { this->m_active = index; }
 /******************************************************************************
  * EffectBase
  ******************************************************************************/
-void EffectBase::update(void) {
+void EffectBase::update(uint32_t dt_us) {
+    (void)dt_us;
     this->m_pixels_ptr->updatePixels(this->m_leds);
 }
 
+void EffectBase::render(uint16_t first, uint16_t last) {
+    this->m_pixels_ptr->updateSegment(
+        LedsSpan(this->m_leds.data() + first, last - first), first, last);
+}
+
+Q16_16 EffectBase::toTicks(uint32_t dt_us) {
+    if (dt_us > EFFECT_MAX_STEP_US) {
+        dt_us = EFFECT_MAX_STEP_US;
+    }
+    return Q16_16::fromRaw((int32_t)(((uint64_t)dt_us * Q16_16::one() +
+                                      EFFECT_TICK_US / 2) /
+                                     EFFECT_TICK_US));
+}
+
 /******************************************************************************
  * HeatBase
  ******************************************************************************/
-void HeatBase::update(void) {
-    for (int i = 0; i < m_heat.count(); i++) {
-        uint32_t &value = m_heat[i];
-        value = (value < m_min_heat)   ? m_min_heat
-                : (value > m_max_heat) ? m_max_heat
-                                       : value;
-        m_palette.interp(value, m_leds[i]);
-        m_palette.correct_colors(m_leds[i]);
+template <typename T>
+HeatBase<T>::HeatBase(ILedStrip *pixels, const Palette &palette)
+    : EffectBase(pixels, palette), m_heat(m_leds.count(), MEMORY_HOT),
+      m_colors() {
+    if (sizeof(T) == 1) {
+        m_colors = LedsList(256, MEMORY_HOT);
+        for (size_t value = 0; value < m_colors.count(); value++) {
+            m_palette.lookup(value, m_colors[value]);
+        }
     }
-    EffectBase::update();
+}
+
+template <typename T> void HeatBase<T>::limitField(void) {
+    for (T &value : m_heat.cells()) {
+        value = limitHeat(value);
+    }
+}
+
+template <typename T> void HeatBase<T>::update(uint32_t dt_us) {
+    this->step(dt_us);
+    this->render(0, m_leds.count());
+}
+
+template <typename T>
+void HeatBase<T>::render(uint16_t first, uint16_t last) {
+    Span<T> runs[2];
+    m_heat.range(first, last, runs[0], runs[1]);
+    ::Color *leds = m_leds.data() + first;
+    for (size_t run = 0; run < COUNT_OF(runs); run++) {
+        if (m_colors.count() > 0) {
+            const ::Color *colors = m_colors.data();
+            for (T value : runs[run]) {
+                *leds++ = colors[value];
+            }
+        } else {
+            for (T value : runs[run]) {
+                m_palette.lookup(value, *leds++);
+            }
+        }
+    }
+    EffectBase::render(first, last);
 }
 
 /******************************************************************************
  * Sparks
  ******************************************************************************/
-void Sparks::update(void) {
-    this->m_cold_down_val += this->m_cold_down;
-    if (this->m_cold_down_val > 1 || this->m_cold_down_val < -1) {
-        int32_t val = (int32_t)(this->m_cold_down_val);
-        for (int i = 0; i < this->m_heat.count(); i++) {
-            uint32_t &value = this->m_heat[i];
-            int64_t new_val = (int64_t)value + (int64_t)val;
-            if (new_val < 0) {
-                value = 0;
-            } else {
-                value = (uint32_t)new_val;
-            }
+template <typename T> void Sparks<T>::step(uint32_t dt_us) {
+    const Q16_16 one = Q16_16::fromInt(1);
+    const Q16_16 ticks = this->toTicks(dt_us);
+    this->m_cold_down_val += this->m_cold_down * ticks;
+    if (this->m_cold_down_val > one || this->m_cold_down_val < -one) {
+        int32_t val = this->m_cold_down_val.toInt();
+        for (T &value : this->m_heat.cells()) {
+            value = this->limitHeat((int64_t)value + val);
         }
-        this->m_cold_down_val -= val;
-    }
-    this->m_sparks_val += this->m_num_of_sparks;
-    if (this->m_sparks_val > 1) {
-        uint32_t count = (uint32_t)(this->m_sparks_val);
-        for (int i = 0; i < count; i++) {
-            size_t index = rand() % this->m_heat.count();
-            this->m_heat[index] = this->m_spark_value;
+        this->m_cold_down_val -= Q16_16::fromInt(val);
+    }
+    this->m_sparks_val += this->m_num_of_sparks * ticks;
+    if (this->m_sparks_val > one) {
+        uint32_t count = this->m_sparks_val.toInt();
+        T value = this->limitHeat(this->m_spark_value.toInt());
+        uint32_t indexes[16];
+        // After a long step more sparks than cells would only hit the same
+        // cells again
+        uint32_t placed = count < this->m_heat.count() ? count
+                                                       : this->m_heat.count();
+        for (uint32_t left = placed; left > 0;) {
+            uint32_t batch = left < COUNT_OF(indexes) ? left
+                                                      : COUNT_OF(indexes);
+            this->m_random.indexes(indexes, batch, this->m_heat.count());
+            for (uint32_t i = 0; i < batch; i++) {
+                this->m_heat[indexes[i]] = value;
+            }
+            left -= batch;
         }
-        this->m_sparks_val -= count;
+        this->m_sparks_val -= Q16_16::fromInt(count);
     }
-    HeatBase::update();
 }
 
 /******************************************************************************
  * Roll
  ******************************************************************************/
-void shift(ArrayList<uint32_t> &data, int32_t count, uint32_t new_value) {
-    if (count > 0) {
-        int start = data.count() - 1;
-        int end = count;
-        for (int i = start; i >= end; i--) {
-            data[i] = data[i - count];
-        }
-        for (int i = 0; i < end; i++) {
-            data[i] = new_value;
-        }
+template <typename T> Q48_16 Roll<T>::wrapHeat(Q48_16 heat) const {
+    int64_t span = (int64_t)this->m_max_heat - this->m_min_heat + 1;
+    if (span <= 0) {
+        return Q48_16::fromInt(this->m_min_heat);
     }
-    if (count < 0) {
-        int start = 0;
-        int end = data.count() - count;
-        for (int i = start; i < end; i++) {
-            data[i] = data[i + count];
-        }
-        for (int i = end; i < data.count(); i++) {
-            data[i] = new_value;
-        }
+    int64_t raw = heat.raw() - (int64_t)this->m_min_heat * Q48_16::one();
+    int64_t range = span * Q48_16::one();
+    raw %= range;
+    if (raw < 0) {
+        raw += range;
     }
+    return Q48_16::fromRaw(raw + (int64_t)this->m_min_heat * Q48_16::one());
 }
 
-void Roll::update(void) {
-    this->m_heat_count += this->m_heat_speed;
-    this->m_roll_count += this->m_roll_speed;
-    if (this->m_heat_count > this->m_max_heat) {
-        this->m_heat_count = this->m_min_heat;
-    } else if (this->m_heat_count < this->m_min_heat) {
-        this->m_heat_count = this->m_max_heat;
-    }
+template <typename T> void Roll<T>::step(uint32_t dt_us) {
+    const Q16_16 one = Q16_16::fromInt(1);
+    const Q16_16 ticks = this->toTicks(dt_us);
+    this->m_heat_count = wrapHeat(this->m_heat_count +
+                                  this->overTicks(this->m_heat_speed, ticks));
+    this->m_roll_count += this->m_roll_speed * ticks;
 
-    if (this->m_roll_count >= 1.0f || this->m_roll_count <= -1.0f) {
-        int32_t count = (int32_t)this->m_roll_count;
-        shift(this->m_heat, count, (uint32_t)this->m_heat_count);
-        this->m_roll_count -= count;
+    if (this->m_roll_count >= one || this->m_roll_count <= -one) {
+        int32_t count = this->m_roll_count.toInt();
+        this->m_heat.scroll(count,
+                            this->limitHeat(this->m_heat_count.toInt()));
+        this->m_roll_count -= Q16_16::fromInt(count);
+        // Cells scrolled in by one long step get the heat they would have
+        // had scrolling in one by one, the newest first
+        size_t moved = count < 0 ? -count : count;
+        if (moved > this->m_heat.count()) {
+            moved = this->m_heat.count();
+        }
+        Q16_16 speed = this->m_roll_speed < Q16_16() ? -this->m_roll_speed
+                                                     : this->m_roll_speed;
+        Q48_16 per_cell = Q48_16::from(this->m_heat_speed / speed);
+        Q48_16 heat = this->m_heat_count;
+        for (size_t i = 1; i < moved; i++) {
+            heat = wrapHeat(heat - per_cell);
+            size_t index = count > 0 ? i : this->m_heat.count() - 1 - i;
+            this->m_heat[index] = this->limitHeat(heat.toInt());
+        }
     }
-    HeatBase::update();
 }
 
 /******************************************************************************
- * Sparks
+ * Pulses
  ******************************************************************************/
-
-void Pulses::update(void) {
+template <typename T> void Pulses<T>::step(uint32_t dt_us) {
     if (this->m_direction == 0) {
-        this->m_current = 0;
+        this->m_current = Q48_16();
         this->m_direction = 1;
     }
 
-    this->m_current += this->m_direction * this->m_speed;
-    if (this->m_current > (float)(this->m_max_heat)) {
-        this->m_current = this->m_max_heat;
-        this->m_direction = -1;
-    } else if (this->m_current < (float)(this->m_min_heat)) {
-        this->m_current = this->m_min_heat;
-        this->m_direction = 1;
-    }
-    for (int i = 0; i < this->m_heat.count(); i++) {
-        this->m_heat[i] = this->m_current;
+    const Q48_16 min = Q48_16::fromInt(this->m_min_heat);
+    const Q48_16 max = Q48_16::fromInt(this->m_max_heat);
+    if (max <= min) {
+        this->m_current = min;
+    } else {
+        // Position on one cycle, up from min then back down from max, so a
+        // long step may bounce off the limits several times
+        int64_t range = (max - min).raw();
+        int64_t period = 2 * range;
+        int64_t pos = (this->m_current - min).raw();
+        if (this->m_direction < 0) {
+            pos = period - pos;
+        }
+        int64_t step =
+            this->overTicks(this->m_speed, this->toTicks(dt_us)).raw();
+        pos = (pos + step) % period;
+        if (pos < 0) {
+            pos += period;
+        }
+        if (pos <= range) {
+            this->m_current = min + Q48_16::fromRaw(pos);
+            this->m_direction = 1;
+        } else {
+            this->m_current = min + Q48_16::fromRaw(period - pos);
+            this->m_direction = -1;
+        }
     }
-
-    HeatBase::update();
+    this->m_heat.fill(this->limitHeat(this->m_current.toInt()));
 }
+
+template class HeatBase<uint8_t>;
+template class HeatBase<uint16_t>;
+template class HeatBase<uint32_t>;
+template class Sparks<uint8_t>;
+template class Sparks<uint16_t>;
+template class Sparks<uint32_t>;
+template class Roll<uint8_t>;
+template class Roll<uint16_t>;
+template class Roll<uint32_t>;
+template class Pulses<uint8_t>;
+template class Pulses<uint16_t>;
+template class Pulses<uint32_t>;
@@ -0,0 +1,370 @@
+#include "frame_recording.h"
+#include <Arduino.h>
+
+static void put_u16(uint8_t *data, uint16_t value) {
+    data[0] = (uint8_t)value;
+    data[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t *data, uint32_t value) {
+    put_u16(data, (uint16_t)value);
+    put_u16(data + 2, (uint16_t)(value >> 16));
+}
+
+static uint16_t get_u16(const uint8_t *data) {
+    return (uint16_t)(data[0] | (data[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *data) {
+    return get_u16(data) | ((uint32_t)get_u16(data + 2) << 16);
+}
+
+// Stored pixel layout, R, G, B and W if there are 4 channels
+static void pack_pixel(uint8_t *data, const ::Color &color,
+                       uint8_t channels) {
+    data[0] = color.R();
+    data[1] = color.G();
+    data[2] = color.B();
+    if (channels > 3) {
+        data[3] = color.W();
+    }
+}
+
+static ::Color unpack_pixel(const uint8_t *data, uint8_t channels) {
+    uint32_t white = channels > 3 ? data[3] : 0;
+    return ::Color((white << 24) | ((uint32_t)data[0] << 16) |
+                   ((uint32_t)data[1] << 8) | data[2]);
+}
+
+/******************************************************************************
+ * Sources and sinks
+ ******************************************************************************/
+size_t MemoryFrameSource::read(uint8_t *data, size_t len) {
+    if (len > m_size - m_pos) {
+        len = m_size - m_pos;
+    }
+    memcpy(data, m_data + m_pos, len);
+    m_pos += len;
+    return len;
+}
+
+FileFrameSource::~FileFrameSource() {
+    if (m_file != nullptr) {
+        fclose(m_file);
+    }
+}
+
+size_t FileFrameSource::read(uint8_t *data, size_t len) {
+    return m_file != nullptr ? fread(data, 1, len, m_file) : 0;
+}
+
+bool FileFrameSource::rewind(void) {
+    return m_file != nullptr && fseek(m_file, 0, SEEK_SET) == 0;
+}
+
+FileFrameSink::~FileFrameSink() {
+    if (m_file != nullptr) {
+        fclose(m_file);
+    }
+}
+
+bool FileFrameSink::write(const uint8_t *data, size_t len) {
+    return m_file != nullptr && fwrite(data, 1, len, m_file) == len;
+}
+
+/******************************************************************************
+ * FrameEncoder
+ ******************************************************************************/
+FrameEncoder::FrameEncoder(IFrameSink *sink, const RecordingInfo &info)
+    : m_sink(sink), m_info(info),
+      m_current(info.channels * info.num_pixels, MEMORY_COLD),
+      m_previous(info.channels * info.num_pixels, MEMORY_COLD),
+      // Worst case is one token per 128 literal bytes
+      m_payload(RECORDING_FRAME_HEADER_SIZE + m_current.count() +
+                    m_current.count() / 128 + 1,
+                MEMORY_COLD),
+      m_frames(0), m_size(0) {}
+
+bool FrameEncoder::writeHeader(void) {
+    uint8_t header[RECORDING_HEADER_SIZE] = {0};
+    memcpy(header, RECORDING_MAGIC, 4);
+    header[4] = RECORDING_VERSION;
+    header[5] = m_info.channels;
+    put_u16(header + 6, m_info.num_pixels);
+    put_u16(header + 8, m_info.frame_rate);
+    put_u16(header + 10, m_info.keyframe_interval);
+    m_size += sizeof(header);
+    return m_sink->write(header, sizeof(header));
+}
+
+bool FrameEncoder::addFrame(LedsSpan frame) {
+    if (m_frames == 0 && !writeHeader()) {
+        return false;
+    }
+    bool key = m_frames == 0 || (m_info.keyframe_interval != 0 &&
+                                 m_frames % m_info.keyframe_interval == 0);
+    uint8_t channels = m_info.channels;
+    uint8_t *current = m_current.data();
+    const uint8_t *previous = m_previous.data();
+    size_t count = frame.count() < m_info.num_pixels ? frame.count()
+                                                     : m_info.num_pixels;
+    for (size_t i = 0; i < count; i++) {
+        pack_pixel(current + i * channels, frame[i], channels);
+    }
+    size_t total = m_current.count();
+    auto delta = [&](size_t i) -> uint8_t {
+        return key ? current[i] : current[i] ^ previous[i];
+    };
+
+    uint8_t *out = m_payload.data() + RECORDING_FRAME_HEADER_SIZE;
+    size_t i = 0;
+    while (i < total) {
+        size_t run = 0;
+        while (i + run < total && delta(i + run) == 0) {
+            run++;
+        }
+        if (i + run == total) {
+            // Unchanged bytes at the end need no token
+            break;
+        }
+        i += run;
+        for (; run > 128; run -= 128) {
+            *out++ = 0x7f;
+        }
+        if (run > 0) {
+            *out++ = (uint8_t)(run - 1);
+        }
+        // A single unchanged byte is cheaper as a literal than as a skip
+        size_t len = 0;
+        while (i + len < total && len < 128) {
+            if (delta(i + len) == 0 &&
+                (i + len + 1 == total || delta(i + len + 1) == 0)) {
+                break;
+            }
+            len++;
+        }
+        *out++ = (uint8_t)(0x7f + len);
+        for (size_t j = 0; j < len; j++) {
+            *out++ = delta(i + j);
+        }
+        i += len;
+    }
+
+    memcpy(m_previous.data(), current, total);
+    uint8_t *record = m_payload.data();
+    uint32_t size = out - record;
+    record[0] = key ? RECORDING_KEYFRAME : RECORDING_DELTA;
+    put_u32(record + 1, size - RECORDING_FRAME_HEADER_SIZE);
+    m_frames++;
+    m_size += size;
+    return m_sink->write(record, size);
+}
+
+/******************************************************************************
+ * FrameDecoder
+ ******************************************************************************/
+FrameDecoder::FrameDecoder(IFrameSource *source)
+    : m_source(source), m_info{0, 0, 0, 0}, m_data(), m_frame(), m_output(),
+      m_strip(nullptr), m_keyframe(false) {}
+
+void FrameDecoder::setOutput(Span<::Color> frame, ILedStrip *strip) {
+    m_frame = LedsList();
+    m_output = frame;
+    m_strip = strip;
+}
+
+bool FrameDecoder::begin(void) {
+    uint8_t header[RECORDING_HEADER_SIZE];
+    if (m_source == nullptr || !m_source->rewind() ||
+        m_source->read(header, sizeof(header)) != sizeof(header)) {
+        return false;
+    }
+    if (memcmp(header, RECORDING_MAGIC, 4) != 0 ||
+        header[4] != RECORDING_VERSION || header[5] < 3 || header[5] > 4) {
+        return false;
+    }
+    m_info.channels = header[5];
+    m_info.num_pixels = get_u16(header + 6);
+    m_info.frame_rate = get_u16(header + 8);
+    m_info.keyframe_interval = get_u16(header + 10);
+    if (m_output.data() == m_frame.data() &&
+        m_frame.count() != m_info.num_pixels) {
+        m_frame = LedsList(m_info.num_pixels, MEMORY_HOT);
+        m_output = m_frame;
+    }
+    if (m_data.count() != m_info.channels * m_info.num_pixels) {
+        m_data = ArrayList<uint8_t>(m_info.channels * m_info.num_pixels,
+                                    MEMORY_HOT);
+    }
+    memset((void *)m_output.data(), 0, sizeof(::Color) * m_output.count());
+    memset(m_data.data(), 0, m_data.count());
+    return m_info.frame_rate != 0;
+}
+
+bool FrameDecoder::rewind(void) {
+    uint8_t header[RECORDING_HEADER_SIZE];
+    return m_source->rewind() &&
+           m_source->read(header, sizeof(header)) == sizeof(header);
+}
+
+bool FrameDecoder::nextFrame(void) {
+    uint8_t record[RECORDING_FRAME_HEADER_SIZE];
+    if (m_source->read(record, sizeof(record)) != sizeof(record)) {
+        return false;
+    }
+    m_keyframe = record[0] == RECORDING_KEYFRAME;
+    if (m_keyframe) {
+        memset(m_data.data(), 0, m_data.count());
+        memset((void *)m_output.data(), 0,
+               sizeof(::Color) * m_output.count());
+    } else if (record[0] != RECORDING_DELTA) {
+        return false;
+    }
+    bool valid = applyPayload(get_u32(record + 1));
+    if (m_keyframe && m_strip != nullptr) {
+        m_strip->updatePixels(m_output);
+    }
+    m_keyframe = false;
+    return valid;
+}
+
+void FrameDecoder::unpack(size_t pos, size_t len) {
+    uint8_t channels = m_info.channels;
+    const uint8_t *data = m_data.data();
+    size_t first = pos / channels;
+    size_t last = (pos + len - 1) / channels + 1;
+    if (last > m_output.count()) {
+        last = m_output.count();
+    }
+    for (size_t i = first; i < last; i++) {
+        m_output[i] = unpack_pixel(data + i * channels, channels);
+    }
+    if (m_strip != nullptr && !m_keyframe && first < last) {
+        m_strip->updateSegment(
+            LedsSpan(m_output.data() + first, last - first), first, last);
+    }
+}
+
+bool FrameDecoder::applyPayload(uint32_t len) {
+    uint8_t *data = m_data.data();
+    size_t total = m_data.count();
+    size_t pos = 0;
+    // Bytes of the current literal not read yet, literals may span chunks
+    size_t literal = 0;
+    while (len > 0) {
+        size_t chunk = len < sizeof(m_buffer) ? len : sizeof(m_buffer);
+        if (m_source->read(m_buffer, chunk) != chunk) {
+            return false;
+        }
+        len -= chunk;
+        size_t i = 0;
+        while (i < chunk) {
+            if (literal == 0) {
+                uint8_t token = m_buffer[i++];
+                if (token < 0x80) {
+                    pos += token + 1;
+                } else {
+                    literal = token - 0x7f;
+                }
+                continue;
+            }
+            size_t count = chunk - i < literal ? chunk - i : literal;
+            if (pos + count > total) {
+                return false;
+            }
+            for (size_t j = 0; j < count; j++) {
+                data[pos + j] ^= m_buffer[i + j];
+            }
+            // Only the pixels that changed are converted back to colors
+            unpack(pos, count);
+            pos += count;
+            i += count;
+            literal -= count;
+        }
+    }
+    return literal == 0;
+}
+
+/******************************************************************************
+ * FrameRecorder
+ ******************************************************************************/
+FrameRecorder::FrameRecorder(IFrameSink *sink, uint16_t num_pixels,
+                             uint16_t frame_rate, uint16_t keyframe_interval,
+                             uint8_t channels)
+    : m_sink(sink), m_frame(num_pixels, MEMORY_COLD),
+      m_encoder(sink, RecordingInfo{channels, num_pixels, frame_rate,
+                                    keyframe_interval}) {}
+
+FrameRecorder::~FrameRecorder() {
+    if (m_sink != nullptr) {
+        delete m_sink;
+    }
+}
+
+void FrameRecorder::updateSegment(LedsSpan leds, size_t start, size_t end) {
+    if (m_frame.count() < end) {
+        end = m_frame.count();
+    }
+    if (start < end) {
+        memcpy((void *)(m_frame.data() + start), (const void *)leds.data(),
+               sizeof(::Color) * (end - start));
+    }
+}
+
+void FrameRecorder::updatePixels(LedsSpan leds) {
+    updateSegment(leds, 0, leds.count());
+}
+
+void FrameRecorder::updatePixel(uint16_t index, ::Color color) {
+    if (index < m_frame.count()) {
+        m_frame[index] = color;
+    }
+}
+
+/******************************************************************************
+ * PlaybackEffect
+ ******************************************************************************/
+PlaybackEffect::PlaybackEffect(ILedStrip *led_strip, IFrameSource *source)
+    : EffectBase(led_strip, Palette(1, Color::BLACK, Color::WHITE)),
+      m_source(source), m_decoder(source), m_valid(false), m_loop(true),
+      m_frame_interval_us(0), m_time_us(0), m_next_frame_us(0),
+      m_played_frames(0) {
+    // Frames are decoded into m_leds and the changes go to the strip right
+    // away, so update() has no frame to copy
+    m_decoder.setOutput(m_leds, led_strip);
+    m_valid = m_decoder.begin();
+    if (m_valid) {
+        m_frame_interval_us = 1000000 / m_decoder.getInfo().frame_rate;
+    }
+}
+
+PlaybackEffect::~PlaybackEffect() {
+    if (m_source != nullptr) {
+        delete m_source;
+    }
+}
+
+void PlaybackEffect::update(uint32_t dt_us) {
+    if (!this->m_valid) {
+        return;
+    }
+    // The first frame is shown right away
+    if (this->m_played_frames > 0) {
+        this->m_time_us += dt_us;
+    }
+    uint32_t now = this->m_time_us;
+    while ((int32_t)(now - this->m_next_frame_us) >= 0) {
+        if (!this->m_decoder.nextFrame()) {
+            if (!this->m_loop || !this->m_decoder.rewind() ||
+                !this->m_decoder.nextFrame()) {
+                break;
+            }
+        }
+        this->m_played_frames++;
+        this->m_next_frame_us += this->m_frame_interval_us;
+        // Too far behind to catch up, go on from the current frame
+        if ((int32_t)(now - this->m_next_frame_us) > 1000000) {
+            this->m_next_frame_us = now;
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#include "heat_field.h"
+
+/******************************************************************************
+ * HeatField
+ ******************************************************************************/
+template <typename T> void HeatField<T>::fill(T value) {
+    for (size_t i = 0; i < m_cells.count(); i++) {
+        m_cells[i] = value;
+    }
+}
+
+template <typename T> void HeatField<T>::scroll(int32_t steps, T value) {
+    size_t count = m_cells.count();
+    size_t moved = steps < 0 ? -(int64_t)steps : steps;
+    if (moved >= count) {
+        fill(value);
+        return;
+    }
+    if (steps > 0) {
+        // The last cells wrap around and become the first ones
+        m_origin = m_origin >= moved ? m_origin - moved
+                                     : m_origin + count - moved;
+        for (size_t i = 0; i < moved; i++) {
+            (*this)[i] = value;
+        }
+    } else if (steps < 0) {
+        m_origin = wrap(moved);
+        for (size_t i = count - moved; i < count; i++) {
+            (*this)[i] = value;
+        }
+    }
+}
+
+template class HeatField<uint8_t>;
+template class HeatField<uint16_t>;
+template class HeatField<uint32_t>;
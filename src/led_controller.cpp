@@ -5,14 +5,37 @@
  * LedStrip
  ******************************************************************************/
 LedStrip::LedStrip(uint16_t n, int16_t pin, neoPixelType type)
-    : Adafruit_NeoPixel(n, pin, type), m_type(type), m_buffer(nullptr),
-      m_mutex(), m_segments(0) {
-    m_buffer = (uint8_t *)calloc(sizeof(uint8_t), this->numBytes);
+    : Adafruit_NeoPixel(n, pin, type), m_type(type),
+      m_encoder(GetPixelEncoder(type)), m_back(0), m_last_published(1),
+      m_pending(false), m_frame_signal(nullptr), m_shared(1), m_front(2),
+      m_output(nullptr), m_drawn_generation(0), m_wire(nullptr),
+      m_dither_error(nullptr), m_published_frames(0), m_drawn_frames(0),
+      m_skipped_frames(0), m_segments(0) {
+    uint8_t *frames = (uint8_t *)led_calloc(3, this->numBytes, MEMORY_HOT);
+    for (uint32_t i = 0; i < COUNT_OF(m_frames); i++) {
+        m_frames[i] = frames + i * this->numBytes;
+    }
+    m_channels[this->rOffset] = ColorPipeline::CHANNEL_RED;
+    m_channels[this->gOffset] = ColorPipeline::CHANNEL_GREEN;
+    m_channels[this->bOffset] = ColorPipeline::CHANNEL_BLUE;
+    if (hasWhite()) {
+        m_channels[this->wOffset] = ColorPipeline::CHANNEL_WHITE;
+    }
+    m_output = CreateLedOutput(*this, pin, type);
 }
 
 LedStrip::~LedStrip() {
-    if (m_buffer) {
-        free(m_buffer);
+    if (m_output) {
+        delete m_output;
+    }
+    if (m_frames[0]) {
+        led_free(m_frames[0]);
+    }
+    if (m_wire) {
+        led_free(m_wire);
+    }
+    if (m_dither_error) {
+        led_free(m_dither_error);
     }
     for (uint32_t i = 0; i < m_segments.count(); i++) {
         ILedStrip *ptr = m_segments[i];
@@ -28,76 +51,301 @@ ILedStrip *LedStrip::GetSegment(uint32_t start, uint32_t end) {
     return ptr;
 }
 
+ILedStrip *LedStrip::GetSegment(const PixelMap &map) {
+    if (map.count() > 0 && this->numLEDs <= map.maxIndex()) {
+        return nullptr;
+    }
+    ILedStrip *ptr = new LedStripSegment(this, map);
+    m_segments.add(ptr);
+    return ptr;
+}
+
 void LedStrip::ReleaseSegment(ILedStrip *segment) {
     m_segments.remove(segment);
     delete segment;
 }
 
-void LedStrip::updateSegment(const LedsList &leds, size_t start, size_t end) {
-    LockGuard lock(this->m_mutex);
+void LedStrip::updateSegment(LedsSpan leds, size_t start, size_t end) {
+    writePixels(leds.data(), start, end);
+}
 
-    if (this->numLEDs < start) {
-        return;
-    }
+void LedStrip::updateMapped(LedsSpan leds, size_t start, size_t end,
+                            const PixelMap &map) {
+    writeMapped(leds.data(), start, end, map);
+}
+
+void LedStrip::writePixels(const ::Color *colors, size_t start, size_t end) {
     if (this->numLEDs < end) {
         end = this->numLEDs;
     }
-    uint8_t bytes = hasWhite() ? 4 : 3;
-    for (uint16_t i = start; i < end; i++) {
-        const ::Color &color = leds[i - start];
-        uint8_t *p = &(this->m_buffer[i * bytes]);
-        p[this->rOffset] = color.R();
-        p[this->gOffset] = color.G();
-        p[this->bOffset] = color.B();
+    if (end <= start) {
+        return;
+    }
+    uint8_t *buffer = this->m_frames[this->m_back];
+    uint8_t diff = 0;
+    if (this->m_encoder.span != nullptr) {
+        diff = this->m_encoder.span(buffer, start, colors, end - start);
+    } else {
+        for (uint16_t i = start; i < end; i++) {
+            diff |= encodePixel(buffer, i, colors[i - start]);
+        }
+    }
+    if (diff != 0) {
+        this->m_pending = true;
+    }
+}
+
+void LedStrip::writeMapped(const ::Color *colors, size_t start, size_t end,
+                           const PixelMap &map) {
+    if (map.count() < end) {
+        end = map.count();
+    }
+    if (end <= start) {
+        return;
+    }
+    if (map.isLinear()) {
+        writePixels(colors, map.start() + start, map.start() + end);
+        return;
+    }
+    uint8_t *buffer = this->m_frames[this->m_back];
+    const uint16_t *table = map.table();
+    uint8_t diff = 0;
+    if (this->m_encoder.mapped != nullptr) {
+        diff = this->m_encoder.mapped(buffer, table + start, colors,
+                                      end - start);
+    } else {
+        for (size_t i = start; i < end; i++) {
+            diff |= encodePixel(buffer, table[i], colors[i - start]);
+        }
+    }
+    if (diff != 0) {
+        this->m_pending = true;
+    }
+}
+
+void LedStrip::writeRgb(const uint8_t *rgb, size_t start, size_t count) {
+    if (this->numLEDs <= start) {
+        return;
+    }
+    if (this->numLEDs - start < count) {
+        count = this->numLEDs - start;
+    }
+    uint8_t *buffer = this->m_frames[this->m_back];
+    uint8_t diff = 0;
+    if (this->m_encoder.rgb != nullptr) {
+        diff = this->m_encoder.rgb(buffer, start, rgb, count);
+    } else {
+        for (size_t i = 0; i < count; i++, rgb += 3) {
+            diff |= encodePixel(buffer, start + i,
+                                ::Color(rgb[0], rgb[1], rgb[2]));
+        }
+    }
+    if (diff != 0) {
+        this->m_pending = true;
     }
 }
 
-void LedStrip::updatePixels(const LedsList &leds) {
+void LedStrip::updatePixels(LedsSpan leds) {
     updateSegment(leds, 0, leds.count());
 }
 
 void LedStrip::updatePixel(uint16_t index, ::Color color) {
-    LockGuard lock(this->m_mutex);
-    uint8_t bytes = this->hasWhite() ? 4 : 3;
-    uint8_t *p = &(this->m_buffer[index * bytes]);
-    p[this->rOffset] = color.R();
-    p[this->gOffset] = color.G();
-    p[this->bOffset] = color.B();
+    if (this->numLEDs <= index) {
+        return;
+    }
+    if (encodePixel(this->m_frames[this->m_back], index, color) != 0) {
+        this->m_pending = true;
+    }
+}
+
+void LedStrip::publish(void) {
+    if (this->m_pending == false) {
+        return;
+    }
+    this->m_pending = false;
+    uint32_t shared = this->m_shared.exchange(this->m_back | FRAME_FRESH,
+                                              std::memory_order_acq_rel);
+    uint32_t published = this->m_back;
+    this->m_last_published = published;
+    this->m_back = shared & FRAME_INDEX_MASK;
+    // Segments only rewrite their own range, so the new back frame has to
+    // start from the frame just published.
+    memcpy(this->m_frames[this->m_back], this->m_frames[published],
+           this->numBytes);
+    this->m_published_frames.fetch_add(1, std::memory_order_relaxed);
+    if (this->m_frame_signal != nullptr) {
+        xSemaphoreGive(this->m_frame_signal);
+    }
+}
+
+void LedStrip::discard(void) {
+    if (this->m_pending == false) {
+        return;
+    }
+    this->m_pending = false;
+    // draw() only reads frames, the last published one is unchanged until
+    // the back frame is published again
+    memcpy(this->m_frames[this->m_back],
+           this->m_frames[this->m_last_published], this->numBytes);
+}
+
+void LedStrip::setOutput(ILedOutput *output) {
+    if (this->m_output != nullptr) {
+        this->m_output->wait(portMAX_DELAY);
+        delete this->m_output;
+    }
+    this->m_output = output;
+}
+
+bool LedStrip::waitDrawn(TickType_t ticks) {
+    return this->m_output == nullptr || this->m_output->wait(ticks);
+}
+
+void LedStrip::setBrightness(uint8_t brightness) {
+    this->m_pipeline.setBrightness(brightness);
+    wakeDraw();
+}
+
+void LedStrip::setGamma(float gamma) {
+    this->m_pipeline.setGamma(gamma);
+    wakeDraw();
+}
+
+void LedStrip::setWhitePoint(const ::Color &white) {
+    this->m_pipeline.setWhitePoint(white);
+    wakeDraw();
+}
+
+void LedStrip::setDithering(bool enable) {
+    this->m_pipeline.setDithering(enable);
+    wakeDraw();
+}
+
+void LedStrip::wakeDraw(void) {
+    if (this->m_frame_signal != nullptr) {
+        xSemaphoreGive(this->m_frame_signal);
+    }
 }
 
 void LedStrip::draw(void) {
-    {
-        LockGuard lock(this->m_mutex);
-        memcpy(this->pixels, this->m_buffer, this->numBytes);
+    if (this->m_output == nullptr) {
+        return;
+    }
+    if (!needsDraw()) {
+        // The strip still shows the last frame, no need to send it again
+        this->m_skipped_frames++;
+        return;
     }
-    this->show();
+    // The front frame belongs to the output until the transfer is done
+    this->m_output->wait(portMAX_DELAY);
+    if (hasNewFrame()) {
+        uint32_t shared =
+            this->m_shared.exchange(this->m_front, std::memory_order_acq_rel);
+        this->m_front = shared & FRAME_INDEX_MASK;
+    }
+    this->m_drawn_generation = this->m_pipeline.getGeneration();
+    const uint8_t *data = this->m_frames[this->m_front];
+    if (!this->m_pipeline.isIdentity()) {
+        if (this->m_wire == nullptr) {
+            this->m_wire = (uint8_t *)led_malloc(this->numBytes, MEMORY_HOT);
+            this->m_dither_error =
+                (uint8_t *)led_calloc(1, this->numBytes, MEMORY_HOT);
+        }
+        this->m_pipeline.apply(data, this->m_wire, this->numBytes,
+                               this->m_channels, hasWhite() ? 4 : 3,
+                               this->m_dither_error);
+        data = this->m_wire;
+    }
+    this->m_output->transmit(data, this->numBytes);
+    this->m_drawn_frames++;
 }
 
 /******************************************************************************
  * LedStripSegment
  ******************************************************************************/
-void LedStripSegment::updateSegment(const LedsList &leds, size_t start,
-                                    size_t end) {
-    if (this->m_leds.count() < start) {
-        return;
+void LedStripSegment::updateSegment(LedsSpan leds, size_t start, size_t end) {
+    if (this->m_led_strip_ptr != nullptr) {
+        this->m_led_strip_ptr->updateMapped(leds, start, end, this->m_map);
     }
-    if (this->m_leds.count() < end) {
-        end = this->m_leds.count();
+}
+
+void LedStripSegment::updatePixels(LedsSpan leds) {
+    updateSegment(leds, 0, leds.count());
+}
+void LedStripSegment::updatePixel(uint16_t index, ::Color color) {
+    if (index < this->m_map.count()) {
+        this->m_led_strip_ptr->updatePixel(this->m_map[index], color);
     }
-    for (uint16_t i = start; i < end; i++) {
-        this->m_leds[i] = leds[i];
+}
+
+/******************************************************************************
+ * LedCanvas
+ ******************************************************************************/
+LedCanvas::LedCanvas(size_t max_parts) : m_parts(), m_num_pixels(0) {
+    m_parts.resize(max_parts);
+}
+
+void LedCanvas::addStrip(LedStrip *strip) {
+    addSegment(strip, PixelMap::linear(0, strip->getNumPixels()));
+}
+
+bool LedCanvas::addSegment(LedStrip *strip, const PixelMap &map) {
+    if (map.count() > 0 && strip->getNumPixels() <= map.maxIndex()) {
+        return false;
     }
-    if (this->m_led_strip_ptr != nullptr) {
-        this->m_led_strip_ptr->updateSegment(this->m_leds, this->m_start,
-                                             this->m_end);
+    Part part;
+    part.strip = strip;
+    part.map = new PixelMap(map);
+    part.offset = m_num_pixels;
+    m_parts.add(part);
+    m_num_pixels += map.count();
+    return true;
+}
+
+LedCanvas::~LedCanvas() {
+    for (int i = 0; i < m_parts.count(); i++) {
+        delete m_parts[i].map;
+    }
+}
+
+void LedCanvas::updateSegment(LedsSpan leds, size_t start, size_t end) {
+    if (m_num_pixels < end) {
+        end = m_num_pixels;
+    }
+    for (int i = 0; i < m_parts.count(); i++) {
+        const Part &part = m_parts[i];
+        size_t part_end = part.offset + part.map->count();
+        if (part_end <= start || end <= part.offset) {
+            continue;
+        }
+        size_t first = start > part.offset ? start : part.offset;
+        size_t last = end < part_end ? end : part_end;
+        part.strip->writeMapped(leds.data() + (first - start),
+                                first - part.offset, last - part.offset,
+                                *part.map);
     }
 }
 
-void LedStripSegment::updatePixels(const LedsList &leds) {
+void LedCanvas::updatePixels(LedsSpan leds) {
     updateSegment(leds, 0, leds.count());
 }
-void LedStripSegment::updatePixel(uint16_t index, ::Color color) {
-    this->m_led_strip_ptr->updatePixel(this->m_start + index, color);
+
+void LedCanvas::updatePixel(uint16_t index, ::Color color) {
+    for (int i = 0; i < m_parts.count(); i++) {
+        const Part &part = m_parts[i];
+        if (part.offset <= index && index < part.offset + part.map->count()) {
+            part.strip->updatePixel((*part.map)[index - part.offset], color);
+            return;
+        }
+    }
+}
+
+void LedCanvas::publish(void) {
+    // publish() is a no-op for strips without new pixels, so strips shared by
+    // several parts are only published once
+    for (int i = 0; i < m_parts.count(); i++) {
+        m_parts[i].strip->publish();
+    }
 }
 
 /******************************************************************************
@@ -105,14 +353,35 @@ void LedStripSegment::updatePixel(uint16_t index, ::Color color) {
  ******************************************************************************/
 LedStripManager::LedStripManager(uint16_t n, int16_t pin, neoPixelType type,
                                  uint32_t refresh_rate, BaseType_t core)
-    : LedStrip(n, pin, type), ITaskManager(refresh_rate, core) {}
+    : LedStrip(n, pin, type), ITaskManager(refresh_rate, core),
+      m_frame_signal(nullptr) {}
+
+LedStripManager::~LedStripManager() {
+    if (m_frame_signal != nullptr) {
+        this->setFrameSignal(nullptr);
+        vSemaphoreDelete(m_frame_signal);
+    }
+}
+
+void LedStripManager::setWaitForFrames(bool enable) {
+    if (enable && m_frame_signal == nullptr) {
+        m_frame_signal = xSemaphoreCreateBinary();
+    }
+    this->setFrameSignal(enable ? m_frame_signal : nullptr);
+}
 
 void LedStripManager::setup(void) {
     this->begin();
     this->clear();
 }
 
-void LedStripManager::update(void) { this->draw(); }
+void LedStripManager::update(void) {
+    if (m_frame_signal != nullptr && !this->needsDraw()) {
+        // Time out now and then so stop() is still noticed
+        xSemaphoreTake(m_frame_signal, pdMS_TO_TICKS(100));
+    }
+    this->draw();
+}
 
 void LedStripManager::cleanup(void) { this->clear(); }
 
@@ -121,7 +390,8 @@ void LedStripManager::cleanup(void) { this->clear(); }
  ******************************************************************************/
 LedStripsManager::LedStripsManager(int max_strips, int refresh_rate,
                                    BaseType_t core)
-    : m_led_strips(), ITaskManager(refresh_rate, core) {
+    : m_led_strips(), ITaskManager(refresh_rate, core),
+      m_frame_signal(nullptr) {
     m_led_strips.resize(max_strips);
 }
 
@@ -132,11 +402,31 @@ LedStripsManager::~LedStripsManager() {
             delete ptr;
         }
     }
+    if (m_frame_signal != nullptr) {
+        vSemaphoreDelete(m_frame_signal);
+    }
+}
+
+void LedStripsManager::setWaitForFrames(bool enable) {
+    if (enable && m_frame_signal == nullptr) {
+        m_frame_signal = xSemaphoreCreateBinary();
+    }
+    for (int i = 0; i < this->m_led_strips.count(); i++) {
+        this->m_led_strips[i]->setFrameSignal(enable ? m_frame_signal
+                                                     : nullptr);
+    }
+}
+
+void LedStripsManager::setBrightness(uint8_t brightness) {
+    for (int i = 0; i < this->m_led_strips.count(); i++) {
+        this->m_led_strips[i]->setBrightness(brightness);
+    }
 }
 
 uint16_t LedStripsManager::addLedStrip(uint16_t number_of_leds, int16_t pin,
                                        neoPixelType type) {
     LedStrip *strip_ptr = new LedStrip(number_of_leds, pin, type);
+    strip_ptr->setFrameSignal(this->m_frame_signal);
     if (this->m_led_strips.add(strip_ptr) == false) {
         delete strip_ptr;
     } else {
@@ -162,7 +452,30 @@ void LedStripsManager::setup(void) {
     }
 }
 
+LedCanvas *LedStripsManager::createCanvas(void) {
+    LedCanvas *canvas = new LedCanvas(this->m_led_strips.count());
+    for (int i = 0; i < this->m_led_strips.count(); i++) {
+        LedStrip *ptr = this->m_led_strips[i];
+        if (ptr != nullptr) {
+            canvas->addStrip(ptr);
+        }
+    }
+    return canvas;
+}
+
 void LedStripsManager::update(void) {
+    if (m_frame_signal != nullptr) {
+        bool fresh = false;
+        for (int i = 0; i < this->m_led_strips.count(); i++) {
+            fresh = fresh || this->m_led_strips[i]->needsDraw();
+        }
+        if (!fresh) {
+            // Time out now and then so stop() is still noticed
+            xSemaphoreTake(m_frame_signal, pdMS_TO_TICKS(100));
+        }
+    }
+    // draw() only starts the transfer, so strips on different pins are sent
+    // at the same time and the frame takes as long as the longest strip
     for (int i = 0; i < this->m_led_strips.count(); i++) {
         LedStrip *ptr = this->m_led_strips[i];
         if (ptr != nullptr) {
@@ -0,0 +1,162 @@
+#include "led_output.h"
+
+/******************************************************************************
+ * NeoPixelOutput
+ ******************************************************************************/
+bool NeoPixelOutput::transmit(const uint8_t *data, size_t len) {
+    memcpy(m_strip.getPixels(), data, len);
+    m_strip.show();
+    notifyComplete();
+    return true;
+}
+
+/******************************************************************************
+ * RmtLedOutput
+ ******************************************************************************/
+#ifdef LED_OUTPUT_HAS_RMT
+// RMT ticks at 10 MHz, 100 ns per tick
+#define RMT_FREQUENCY_HZ 10000000
+
+RmtLedOutput::RmtLedOutput(int16_t pin, neoPixelType type)
+    : m_pin(pin), m_khz400((type & NEO_KHZ400) != 0), m_initialized(false),
+      m_sending(false), m_done_us(0), m_symbols() {}
+
+RmtLedOutput::~RmtLedOutput() {
+    if (m_initialized) {
+        wait(portMAX_DELAY);
+        rmtDeinit(m_pin);
+    }
+}
+
+bool RmtLedOutput::transmit(const uint8_t *data, size_t len) {
+    if (!m_initialized) {
+        m_initialized = rmtInit(m_pin, RMT_TX_MODE, RMT_MEM_NUM_BLOCKS_1,
+                                RMT_FREQUENCY_HZ);
+        if (!m_initialized) {
+            return false;
+        }
+    }
+    if (isBusy()) {
+        return false;
+    }
+    size_t count = len * 8;
+    if (m_symbols.count() < count) {
+        m_symbols = ArrayList<rmt_data_t>(count);
+    }
+    // Bit timings in 100 ns ticks: high/low for a 0 and a 1
+    uint16_t t0h = m_khz400 ? 5 : 4;
+    uint16_t t0l = m_khz400 ? 20 : 8;
+    uint16_t t1h = m_khz400 ? 12 : 8;
+    uint16_t t1l = m_khz400 ? 13 : 4;
+    rmt_data_t *symbol = m_symbols.data();
+    for (size_t i = 0; i < len; i++) {
+        uint8_t byte = data[i];
+        for (uint8_t mask = 0x80; mask != 0; mask >>= 1) {
+            bool one = (byte & mask) != 0;
+            symbol->level0 = 1;
+            symbol->duration0 = one ? t1h : t0h;
+            symbol->level1 = 0;
+            symbol->duration1 = one ? t1l : t0l;
+            symbol++;
+        }
+    }
+    m_sending = rmtWriteAsync(m_pin, m_symbols.data(), count);
+    return m_sending;
+}
+
+bool RmtLedOutput::isBusy(void) {
+    if (m_sending) {
+        if (!rmtTransmitCompleted(m_pin)) {
+            return true;
+        }
+        m_sending = false;
+        m_done_us = micros();
+        notifyComplete();
+    }
+    return (uint32_t)(micros() - m_done_us) < LED_OUTPUT_LATCH_US;
+}
+
+bool RmtLedOutput::wait(TickType_t ticks) {
+    TickType_t start = xTaskGetTickCount();
+    while (isBusy()) {
+        if (m_sending) {
+            if (xTaskGetTickCount() - start >= ticks) {
+                return false;
+            }
+            vTaskDelay(1);
+        } else {
+            uint32_t elapsed = micros() - m_done_us;
+            if (elapsed < LED_OUTPUT_LATCH_US) {
+                delayMicroseconds(LED_OUTPUT_LATCH_US - elapsed);
+            }
+        }
+    }
+    return true;
+}
+#endif
+
+/******************************************************************************
+ * MockLedOutput
+ ******************************************************************************/
+MockLedOutput::MockLedOutput(neoPixelType type)
+    : m_bit_ns((type & NEO_KHZ400) ? 2500 : 1250), m_sending(false),
+      m_done_us(0), m_frame_count(0), m_frame() {}
+
+uint32_t MockLedOutput::getTransferTime(size_t len) const {
+    return (uint32_t)(((uint64_t)len * 8 * m_bit_ns) / 1000) +
+           LED_OUTPUT_LATCH_US;
+}
+
+bool MockLedOutput::transmit(const uint8_t *data, size_t len) {
+    if (isBusy()) {
+        return false;
+    }
+    if (m_frame.count() != len) {
+        m_frame = ArrayList<uint8_t>(len);
+    }
+    memcpy(m_frame.data(), data, len);
+    m_done_us = micros() + getTransferTime(len);
+    m_sending = true;
+    m_frame_count++;
+    return true;
+}
+
+bool MockLedOutput::isBusy(void) {
+    if (m_sending && (int32_t)(micros() - m_done_us) >= 0) {
+        m_sending = false;
+        notifyComplete();
+    }
+    return m_sending;
+}
+
+bool MockLedOutput::wait(TickType_t ticks) {
+    if (!isBusy()) {
+        return true;
+    }
+    uint32_t remaining = m_done_us - micros();
+    if (ticks != portMAX_DELAY && remaining > ticks * portTICK_PERIOD_MS * 1000) {
+        return false;
+    }
+    if (remaining >= 1000 * portTICK_PERIOD_MS) {
+        vTaskDelay(remaining / (1000 * portTICK_PERIOD_MS));
+    }
+    while (isBusy()) {
+        int32_t left = (int32_t)(m_done_us - micros());
+        if (left > 0) {
+            delayMicroseconds(left);
+        }
+    }
+    return true;
+}
+
+ILedOutput *CreateLedOutput(Adafruit_NeoPixel &strip, int16_t pin,
+                            neoPixelType type) {
+#ifdef LED_OUTPUT_HAS_RMT
+    (void)strip;
+    return new RmtLedOutput(pin, type);
+#else
+    (void)pin;
+    (void)type;
+    return new NeoPixelOutput(strip);
+#endif
+}
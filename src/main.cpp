@@ -1,27 +1,41 @@
 #include "effects.h"
 #include <Arduino.h>
 
+#include "palettes.h"
+#include "serial_input.h"
+
 #include "config.h"
 
 #define DEBOUNCE_TIME 60
 
-LedStripManager led_strip(STRIP_LED_COUNT, STRIP_PIN, STRIP_TYPE,
-                          STRIP_REFRESH_RATE, STRIP_TASK_CORE);
-EffectManager effect_manager(EFFECTS_REFRESH_RATE, EFFECTS_TASK_CORE);
+// Created in setup() so they are allocated from the arenas
+LedStripManager *led_strip = nullptr;
+EffectManager *effect_manager = nullptr;
+SerialInput *serial_input = nullptr;
+
+void ReportPalette(const char *name, const Palette &palette) {
+    Serial.printf("%s palette: lut %u bytes, built in %u us\n", name,
+                  (unsigned)palette.getLutSize(),
+                  (unsigned)palette.getLutBuildTime());
+}
 
 void AddSparks(EffectsManager &manager, ILedStrip *segment) {
-    Sparks *effect =
-        new Sparks(segment, Palette(255, Color::WHITE, Color::WHITE));
+    Palette palette(palettes::WHITE);
+    ReportPalette("Sparks", palette);
+    Sparks<uint8_t> *effect = new Sparks<uint8_t>(segment, palette);
     effect->setMinHeat(20);
     effect->setMaxHeat(255);
     effect->setColdDown(-2.5f);
     effect->setNumOfSparks(0.75f);
     effect->setSparkValue(255);
+    effect->setSeed(manager.count());
     manager.AddEffect(effect);
 }
 
 void AddRoll(EffectsManager &manager, ILedStrip *segment) {
-    Roll *effect = new Roll(segment, RainbowPalette(8));
+    Palette palette(palettes::RAINBOW_8);
+    ReportPalette("Roll", palette);
+    Roll<uint8_t> *effect = new Roll<uint8_t>(segment, palette);
     effect->setMinHeat(0);
     effect->setMaxHeat(8);
     effect->setSpeed(0.1f);
@@ -30,7 +44,9 @@ void AddRoll(EffectsManager &manager, ILedStrip *segment) {
 }
 
 void AddPulse(EffectsManager &manager, ILedStrip *segment) {
-    Pulses *effect = new Pulses(segment, RainbowPalette(255));
+    Palette palette(palettes::RAINBOW);
+    ReportPalette("Pulses", palette);
+    Pulses<uint8_t> *effect = new Pulses<uint8_t>(segment, palette);
     effect->setMinHeat(0);
     effect->setMaxHeat(255);
     effect->setSpeed(1);
@@ -66,31 +82,117 @@ int DigitalInput::read(void) {
     return m_last_stable_state;
 }
 
+// Bytes on the serial port that are not pixel packets
+void HandleCommand(uint8_t command) {
+    // 's' dumps the task metrics
+    if (command == 's') {
+        effect_manager->dumpStats();
+        led_strip->dumpStats();
+        serial_input->dumpStats();
+        led_memory_report();
+    }
+}
+
+// Wakes the serial input as soon as bytes arrive on the port
+#if ARDUINO_USB_CDC_ON_BOOT
+void SerialReceived(void *arg, esp_event_base_t base, int32_t id,
+                    void *data) {
+    (void)arg;
+    (void)base;
+    (void)id;
+    (void)data;
+    serial_input->notifyReceived();
+}
+#else
+void SerialReceived(void) { serial_input->notifyReceived(); }
+#endif
+
 DigitalInput button(9);
 void setup() {
-    Serial.begin(9600);
+    Serial.setRxBufferSize(SERIAL_RX_BUFFER_SIZE);
+    Serial.begin(SERIAL_BAUD);
     button.init();
 
-    AddSparks(effect_manager, &led_strip);
-    AddRoll(effect_manager, &led_strip);
-    AddPulse(effect_manager, &led_strip);
+    {
+        // Everything the pipeline keeps is allocated once, here
+        ArenaScope arena;
+        led_strip = new LedStripManager(STRIP_LED_COUNT, STRIP_PIN, STRIP_TYPE,
+                                        STRIP_REFRESH_RATE, STRIP_TASK_CORE);
+        effect_manager =
+            new EffectManager(EFFECTS_REFRESH_RATE, EFFECTS_TASK_CORE);
+        // Shorter strips render faster than a worker wakes up
+        if (STRIP_LED_COUNT >= 2 * EFFECTS_RENDER_CHUNK) {
+            effect_manager->setWorkers(EFFECTS_RENDER_WORKERS,
+                                       EFFECTS_WORKERS_CORE);
+        }
+        serial_input = new SerialInput(&Serial, SERIAL_INPUT_TASK_CORE);
+        serial_input->addStrip(led_strip);
 
-    led_strip.start();
-    effect_manager.start();
+        AddSparks(*effect_manager, led_strip);
+        AddRoll(*effect_manager, led_strip);
+        AddPulse(*effect_manager, led_strip);
+    }
+    led_memory_report();
+
+    led_strip->setName("LedStrip");
+    effect_manager->setName("Effects");
+    led_strip->setBrightness(STRIP_BRIGHTNESS);
+    led_strip->setGamma(STRIP_GAMMA);
+    led_strip->setWhitePoint(STRIP_WHITE_POINT);
+    led_strip->setDithering(STRIP_DITHERING);
+    led_strip->setWaitForFrames(STRIP_WAIT_FOR_FRAMES);
+    led_strip->setPhase(STRIP_PHASE_US);
+    // The effects own the strip until a host streams pixels
+    serial_input->setEnabled(false);
+    serial_input->setCommandHandler(HandleCommand);
+#if ARDUINO_USB_CDC_ON_BOOT && ARDUINO_USB_MODE
+    Serial.onEvent(ARDUINO_HW_CDC_RX_EVENT, SerialReceived);
+#elif ARDUINO_USB_CDC_ON_BOOT
+    Serial.onEvent(ARDUINO_USB_CDC_RX_EVENT, SerialReceived);
+#else
+    Serial.onReceive(SerialReceived);
+#endif
+    led_strip->start();
+    effect_manager->start();
+    serial_input->start();
 }
 
 
 int current_index = 0;
 uint64_t last_update_ms = 0;
 int lastState = LOW;
+bool effects_running = true;
+
+// Hand the strip to the serial input while a host streams pixels, the
+// effects take it back once the host stops
+void SwitchInput(void) {
+    bool streaming = serial_input->isStreaming();
+    if (streaming && effects_running) {
+        effect_manager->stop();
+        effects_running = false;
+    } else if (!streaming && !effects_running &&
+               !effect_manager->isRunning()) {
+        // Returns once the input wrote its last pixel, the strip never has
+        // two writers
+        serial_input->setEnabled(false);
+        effect_manager->start();
+        effects_running = true;
+    }
+    // Frames sent before the effects task finished are dropped
+    if (streaming && !effect_manager->isRunning()) {
+        serial_input->setEnabled(true);
+    }
+}
 
 void loop() {
+    SwitchInput();
+
     int currentState = button.read();
     if ((millis() - last_update_ms) > DEBOUNCE_TIME) {
         last_update_ms = millis();
         if(lastState == HIGH && currentState == LOW) {
-            current_index = (current_index+1)%effect_manager.count();
-            effect_manager.setActive(current_index);
+            current_index = (current_index+1)%effect_manager->count();
+            effect_manager->setActive(current_index);
         }
         lastState = currentState;
     }
@@ -0,0 +1,382 @@
+#include "network_input.h"
+#include "byte_order.h"
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// DDP header, a 4 byte timecode follows when DDP_FLAG_TIME is set
+#define DDP_HEADER_SIZE 10
+#define DDP_FLAG_VERSION_MASK 0xc0
+#define DDP_FLAG_VERSION_1 0x40
+#define DDP_FLAG_QUERY 0x02
+#define DDP_FLAG_REPLY 0x04
+#define DDP_FLAG_STORAGE 0x08
+#define DDP_FLAG_TIME 0x10
+#define DDP_FLAG_PUSH 0x01
+#define DDP_ID_DISPLAY 1
+// Data type of RGB pixels with 8 bits per channel
+#define DDP_TYPE_RGB8 0x0b
+
+// Offsets in E1.31 packets, see ANSI E1.31-2018
+#define E131_ACN_ID 4
+#define E131_ROOT_VECTOR 18
+#define E131_FRAME_VECTOR 40
+#define E131_SYNC_ADDRESS 109
+#define E131_SEQUENCE 111
+#define E131_OPTIONS 112
+#define E131_UNIVERSE 113
+#define E131_PROPERTY_COUNT 123
+#define E131_START_CODE 125
+#define E131_DATA 126
+#define E131_SYNC_SEQUENCE 44
+#define E131_SYNC_UNIVERSE 45
+#define E131_SYNC_SIZE 49
+#define E131_ROOT_DATA 0x00000004
+#define E131_ROOT_EXTENDED 0x00000008
+#define E131_FRAME_DATA 0x00000002
+#define E131_FRAME_SYNC 0x00000001
+#define E131_OPTION_PREVIEW 0x80
+#define E131_OPTION_TERMINATED 0x40
+
+static const uint8_t E131_ACN_IDENTIFIER[12] = {'A', 'S', 'C', '-', 'E', '1',
+                                                '.', '1', '7', 0,   0,   0};
+
+// Distance from last to sequence for sequence numbers of bits bits,
+// negative if sequence is older
+static int8_t sequence_diff(uint8_t sequence, uint8_t last, uint8_t bits) {
+    uint8_t shift = 8 - bits;
+    return (int8_t)((uint8_t)(sequence - last) << shift) >> shift;
+}
+
+/******************************************************************************
+ * NetworkInput
+ ******************************************************************************/
+NetworkInput::NetworkInput(uint16_t ddp_port, uint16_t e131_port,
+                           BaseType_t core)
+    : ITaskManager(0, core), m_space(), m_universes(),
+      m_received(0), m_all_received(0), m_sync_address(0),
+      m_sync_sequence(0), m_sync_seen(false), m_ddp_port(ddp_port),
+      m_e131_port(e131_port), m_ddp_socket(-1), m_e131_socket(-1),
+      m_ddp_sequence(0) {
+    memset(&m_stats, 0, sizeof(m_stats));
+    this->m_name = "NetworkInput";
+}
+
+NetworkInput::~NetworkInput() { end(); }
+
+bool NetworkInput::mapUniverse(uint16_t universe, uint32_t first_pixel,
+                               uint16_t count) {
+    if (m_universes.count() >= NETWORK_INPUT_MAX_UNIVERSES) {
+        return false;
+    }
+    Universe entry = {universe, count, first_pixel, 0, false};
+    m_universes.add(entry);
+    m_all_received = (m_all_received << 1) | 1;
+    return true;
+}
+
+bool NetworkInput::mapUniverses(uint16_t first, uint16_t count) {
+    for (uint16_t i = 0; i < count; i++) {
+        if (!mapUniverse(first + i, (uint32_t)i * E131_PIXELS_PER_UNIVERSE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int NetworkInput::openSocket(uint16_t port) {
+    if (port == 0) {
+        return -1;
+    }
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool NetworkInput::begin(void) {
+    if (m_ddp_socket < 0) {
+        m_ddp_socket = openSocket(m_ddp_port);
+    }
+    if (m_e131_socket < 0) {
+        m_e131_socket = openSocket(m_e131_port);
+    }
+    return (m_ddp_port == 0 || m_ddp_socket >= 0) &&
+           (m_e131_port == 0 || m_e131_socket >= 0);
+}
+
+void NetworkInput::end(void) {
+    if (m_ddp_socket >= 0) {
+        close(m_ddp_socket);
+        m_ddp_socket = -1;
+    }
+    if (m_e131_socket >= 0) {
+        close(m_e131_socket);
+        m_e131_socket = -1;
+    }
+}
+
+uint32_t NetworkInput::drain(int socket, bool ddp) {
+    uint32_t count = 0;
+    if (socket < 0) {
+        return 0;
+    }
+    while (true) {
+        ssize_t len = recv(socket, m_packet, sizeof(m_packet), MSG_DONTWAIT);
+        if (len < 0) {
+            break;
+        }
+        count++;
+        if (ddp) {
+            handleDdp(m_packet, len);
+        } else {
+            handleE131(m_packet, len);
+        }
+    }
+    return count;
+}
+
+uint32_t NetworkInput::poll(void) {
+    return drain(m_ddp_socket, true) + drain(m_e131_socket, false);
+}
+
+void NetworkInput::publish(void) {
+    m_space.publish();
+    m_received = 0;
+    m_stats.frames++;
+}
+
+bool NetworkInput::handleDdp(const uint8_t *data, size_t len) {
+    m_stats.packets++;
+    if (len < DDP_HEADER_SIZE ||
+        (data[0] & DDP_FLAG_VERSION_MASK) != DDP_FLAG_VERSION_1 ||
+        (data[0] & (DDP_FLAG_QUERY | DDP_FLAG_REPLY | DDP_FLAG_STORAGE)) ||
+        data[2] != DDP_TYPE_RGB8 ||
+        (data[3] != DDP_ID_DISPLAY && data[3] != 0)) {
+        m_stats.ignored++;
+        return false;
+    }
+    // Senders may give all packets of a frame the same sequence number, so
+    // only older packets are dropped
+    uint8_t sequence = data[1] & 0x0f;
+    if (sequence != 0 && m_ddp_sequence != 0 &&
+        sequence_diff(sequence, m_ddp_sequence, 4) < 0) {
+        m_stats.out_of_order++;
+        return false;
+    }
+    m_ddp_sequence = sequence;
+    size_t header = DDP_HEADER_SIZE + ((data[0] & DDP_FLAG_TIME) ? 4 : 0);
+    uint32_t offset = get_be32(data + 4);
+    uint16_t length = get_be16(data + 8);
+    if (len < header + length || offset % 3 != 0) {
+        m_stats.ignored++;
+        return false;
+    }
+    m_space.writeRgb(offset / 3, data + header, length / 3);
+    if (data[0] & DDP_FLAG_PUSH) {
+        publish();
+    }
+    return true;
+}
+
+bool NetworkInput::handleE131(const uint8_t *data, size_t len) {
+    m_stats.packets++;
+    if (len < E131_SYNC_SIZE ||
+        memcmp(data + E131_ACN_ID, E131_ACN_IDENTIFIER,
+               sizeof(E131_ACN_IDENTIFIER)) != 0) {
+        m_stats.ignored++;
+        return false;
+    }
+    uint32_t root = get_be32(data + E131_ROOT_VECTOR);
+    uint32_t vector = get_be32(data + E131_FRAME_VECTOR);
+    if (root == E131_ROOT_EXTENDED && vector == E131_FRAME_SYNC) {
+        if (m_sync_address == 0 ||
+            get_be16(data + E131_SYNC_UNIVERSE) != m_sync_address) {
+            m_stats.ignored++;
+            return false;
+        }
+        // Same window as for the universes, a late sync would publish a
+        // frame mixing two frames of the sender
+        uint8_t sequence = data[E131_SYNC_SEQUENCE];
+        int8_t diff = sequence_diff(sequence, m_sync_sequence, 8);
+        if (m_sync_seen && diff <= 0 && diff > -20) {
+            m_stats.out_of_order++;
+            return false;
+        }
+        m_sync_sequence = sequence;
+        m_sync_seen = true;
+        publish();
+        return true;
+    }
+    if (root != E131_ROOT_DATA || vector != E131_FRAME_DATA ||
+        len < E131_DATA || data[E131_START_CODE] != 0 ||
+        (data[E131_OPTIONS] & E131_OPTION_PREVIEW)) {
+        m_stats.ignored++;
+        return false;
+    }
+    uint16_t number = get_be16(data + E131_UNIVERSE);
+    size_t index = 0;
+    while (index < m_universes.count() &&
+           m_universes[index].number != number) {
+        index++;
+    }
+    if (index == m_universes.count()) {
+        m_stats.ignored++;
+        return false;
+    }
+    Universe &universe = m_universes[index];
+    uint8_t sequence = data[E131_SEQUENCE];
+    // Packets up to 20 behind are late, further back the sender restarted
+    int8_t diff = sequence_diff(sequence, universe.sequence, 8);
+    if (universe.seen && diff <= 0 && diff > -20) {
+        m_stats.out_of_order++;
+        return false;
+    }
+    universe.sequence = sequence;
+    universe.seen = true;
+    if (data[E131_OPTIONS] & E131_OPTION_TERMINATED) {
+        universe.seen = false;
+        return true;
+    }
+
+    // The property count includes the start code
+    size_t channels = get_be16(data + E131_PROPERTY_COUNT);
+    channels = channels > 0 ? channels - 1 : 0;
+    if (channels > len - E131_DATA) {
+        channels = len - E131_DATA;
+    }
+    uint32_t count = channels / 3;
+    if (count > universe.count) {
+        count = universe.count;
+    }
+    uint64_t bit = (uint64_t)1 << index;
+    m_sync_address = get_be16(data + E131_SYNC_ADDRESS);
+    if (m_sync_address == 0 && (m_received & bit)) {
+        // The universe started a new frame before the last one was
+        // complete, show what arrived of it
+        publish();
+    }
+    m_space.writeRgb(universe.first_pixel, data + E131_DATA, count);
+    m_received |= bit;
+    if (m_sync_address == 0 && m_received == m_all_received) {
+        publish();
+    }
+    return true;
+}
+
+void NetworkInput::waitForUpdate(void) {
+    int max_fd = m_ddp_socket > m_e131_socket ? m_ddp_socket : m_e131_socket;
+    if (max_fd < 0) {
+        vTaskDelay(pdMS_TO_TICKS(NETWORK_INPUT_TIMEOUT_MS));
+        return;
+    }
+    fd_set sockets;
+    FD_ZERO(&sockets);
+    if (m_ddp_socket >= 0) {
+        FD_SET(m_ddp_socket, &sockets);
+    }
+    if (m_e131_socket >= 0) {
+        FD_SET(m_e131_socket, &sockets);
+    }
+    struct timeval timeout = {0, NETWORK_INPUT_TIMEOUT_MS * 1000};
+    select(max_fd + 1, &sockets, nullptr, nullptr, &timeout);
+}
+
+void NetworkInput::setup(void) { begin(); }
+
+void NetworkInput::update(void) { poll(); }
+
+void NetworkInput::cleanup(void) { end(); }
+
+/******************************************************************************
+ * Packet builders
+ ******************************************************************************/
+// Flags and length field of an E1.31 layer from offset to the packet end
+static void put_e131_length(uint8_t *data, size_t offset, size_t size) {
+    put_be16(data + offset, (uint16_t)(0x7000 | (size - offset)));
+}
+
+size_t BuildDdpPacket(uint8_t *packet, size_t size, uint8_t sequence,
+                      uint32_t first_pixel, const uint8_t *rgb, uint16_t count,
+                      bool push) {
+    size_t length = 3 * (size_t)count;
+    if (size < DDP_HEADER_SIZE + length) {
+        return 0;
+    }
+    packet[0] = DDP_FLAG_VERSION_1 | (push ? DDP_FLAG_PUSH : 0);
+    packet[1] = sequence & 0x0f;
+    packet[2] = DDP_TYPE_RGB8;
+    packet[3] = DDP_ID_DISPLAY;
+    put_be32(packet + 4, 3 * first_pixel);
+    put_be16(packet + 8, (uint16_t)length);
+    memcpy(packet + DDP_HEADER_SIZE, rgb, length);
+    return DDP_HEADER_SIZE + length;
+}
+
+static void put_e131_root(uint8_t *packet, size_t total, uint32_t vector) {
+    put_be16(packet, 0x0010);
+    put_be16(packet + 2, 0);
+    memcpy(packet + E131_ACN_ID, E131_ACN_IDENTIFIER,
+           sizeof(E131_ACN_IDENTIFIER));
+    put_e131_length(packet, 16, total);
+    put_be32(packet + E131_ROOT_VECTOR, vector);
+    // Sender CID, any fixed value identifies this sender
+    memcpy(packet + 22, "led_lights-send", 16);
+}
+
+size_t BuildE131Packet(uint8_t *packet, size_t size, uint8_t sequence,
+                       uint16_t universe, uint16_t sync_address,
+                       const uint8_t *rgb, uint16_t count) {
+    size_t channels = 3 * (size_t)count;
+    size_t total = E131_DATA + channels;
+    if (channels > 512 || size < total) {
+        return 0;
+    }
+    memset(packet, 0, E131_DATA);
+    put_e131_root(packet, total, E131_ROOT_DATA);
+    put_e131_length(packet, 38, total);
+    put_be32(packet + E131_FRAME_VECTOR, E131_FRAME_DATA);
+    strncpy((char *)packet + 44, "led_lights", 64);
+    // Default priority
+    packet[108] = 100;
+    put_be16(packet + E131_SYNC_ADDRESS, sync_address);
+    packet[E131_SEQUENCE] = sequence;
+    put_be16(packet + E131_UNIVERSE, universe);
+    put_e131_length(packet, 115, total);
+    packet[117] = 0x02;
+    packet[118] = 0xa1;
+    put_be16(packet + 119, 0);
+    put_be16(packet + 121, 1);
+    put_be16(packet + E131_PROPERTY_COUNT, (uint16_t)(channels + 1));
+    packet[E131_START_CODE] = 0;
+    memcpy(packet + E131_DATA, rgb, channels);
+    return total;
+}
+
+size_t BuildE131Sync(uint8_t *packet, size_t size, uint8_t sequence,
+                     uint16_t sync_address) {
+    if (size < E131_SYNC_SIZE) {
+        return 0;
+    }
+    memset(packet, 0, E131_SYNC_SIZE);
+    put_e131_root(packet, E131_SYNC_SIZE, E131_ROOT_EXTENDED);
+    put_e131_length(packet, 38, E131_SYNC_SIZE);
+    put_be32(packet + E131_FRAME_VECTOR, E131_FRAME_SYNC);
+    packet[E131_SYNC_SEQUENCE] = sequence;
+    put_be16(packet + E131_SYNC_UNIVERSE, sync_address);
+    return E131_SYNC_SIZE;
+}
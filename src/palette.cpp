@@ -1,5 +1,11 @@
 
 #include "palette.h"
+#include <Arduino.h>
+
+#include "color_kernels.h"
+#include "color_swar.h"
+#include "fixed.h"
+#include "palettes.h"
 
 #define RGB_RED(hex) ((hex >> 16) & 0xff)
 #define RGB_GREEN(hex) ((hex >> 8) & 0xff)
@@ -52,11 +58,7 @@ Color &Color::operator=(const Color &other) {
 }
 
 Color Color::operator*(const Color &other) {
-    // return
-    uint16_t r = (m_r * other.m_r) / 255;
-    uint16_t g = (m_g * other.m_g) / 255;
-    uint16_t b = (m_b * other.m_b) / 255;
-    return Color(CLAMP_UINT8(r), CLAMP_UINT8(g), CLAMP_UINT8(b));
+    return Color(swar_mul(m_value, other.m_value));
 }
 
 Color Color::operator/(const Color &other) {
@@ -66,16 +68,10 @@ Color Color::operator/(const Color &other) {
     return Color(CLAMP_UINT8(r), CLAMP_UINT8(g), CLAMP_UINT8(b));
 }
 Color Color::operator+(const Color &other) {
-    uint16_t r = (m_r + other.m_r);
-    uint16_t g = (m_g + other.m_g);
-    uint16_t b = (m_b + other.m_b);
-    return Color(CLAMP_UINT8(r), CLAMP_UINT8(g), CLAMP_UINT8(b));
+    return Color(swar_add(m_value, other.m_value));
 }
 Color Color::operator-(const Color &other) {
-    int16_t r = (m_r - other.m_r);
-    int16_t g = (m_g - other.m_g);
-    int16_t b = (m_b - other.m_b);
-    return Color(CLAMP_UINT8(r), CLAMP_UINT8(g), CLAMP_UINT8(b));
+    return Color(swar_sub(m_value, other.m_value));
 }
 
 /*==========================================================================
@@ -83,26 +79,70 @@ Color Color::operator-(const Color &other) {
  *==========================================================================*/
 Palette::Palette(const Palette &other)
     : m_colors(other.m_colors), m_colors_map(other.m_colors_map),
-      m_color_correction(other.m_color_correction) {}
+      m_color_correction(other.m_color_correction), m_lut(other.m_lut),
+      m_lut_build_time(other.m_lut_build_time), m_table(other.m_table),
+      m_table_count(other.m_table_count) {
+    if (m_lut.count() > 0) {
+        m_table = m_lut.data();
+    }
+}
+
+Palette &Palette::operator=(const Palette &other) {
+    if (this != &other) {
+        m_colors = other.m_colors;
+        m_colors_map = other.m_colors_map;
+        m_color_correction = other.m_color_correction;
+        m_lut = other.m_lut;
+        m_lut_build_time = other.m_lut_build_time;
+        m_table = other.m_table;
+        m_table_count = other.m_table_count;
+        if (m_lut.count() > 0) {
+            m_table = m_lut.data();
+        }
+    }
+    return *this;
+}
+
+Palette::Palette(const Color *table, size_t count)
+    : m_colors(), m_colors_map(), m_color_correction(Color::WHITE), m_lut(),
+      m_lut_build_time(0), m_table(table), m_table_count(count) {}
 
 Palette::Palette(uint16_t resolution, const Color &color,
                  const Color &color_correction)
-    : m_colors(2), m_colors_map(), m_color_correction(color_correction) {
+    : m_colors(2), m_colors_map(), m_color_correction(color_correction),
+      m_lut(resolution + 1, MEMORY_HOT), m_lut_build_time(0),
+      m_table(nullptr), m_table_count(0) {
     m_colors[1] = color;
     linspace(0, resolution, m_colors.count(), m_colors_map);
+    buildLut();
 }
 
-Palette::Palette(uint16_t resolution, const ArrayList<Color> &colors,
+Palette::Palette(uint16_t resolution, Span<const Color> colors,
                  const Color &color_correction)
-    : m_colors(colors), m_colors_map(), m_color_correction(color_correction) {
+    : m_colors(colors.data(), colors.count()), m_colors_map(),
+      m_color_correction(color_correction),
+      m_lut(resolution + 1, MEMORY_HOT), m_lut_build_time(0),
+      m_table(nullptr), m_table_count(0) {
     linspace(0, resolution, colors.count(), m_colors_map);
+    buildLut();
 }
 
-void Palette::correct_colors(ArrayList<Color> &colors) {
-    for (int i = 0; i < colors.count(); i++) {
-        Color &color = colors[i];
-        correct_colors(color);
+/**
+ * Precompute the corrected color of every value in [0, resolution]
+ */
+void Palette::buildLut(void) {
+    uint32_t start = micros();
+    for (uint32_t i = 0; i < m_lut.count(); i++) {
+        interp(i, m_lut[i]);
     }
+    correct_colors(m_lut);
+    m_table = m_lut.data();
+    m_table_count = m_lut.count();
+    m_lut_build_time = micros() - start;
+}
+
+void Palette::correct_colors(Span<Color> colors) {
+    color_multiply(colors, m_color_correction);
 }
 
 void Palette::correct_colors(Color &color) {
@@ -112,13 +152,18 @@ void Palette::correct_colors(Color &color) {
 /**
  * linear interpolation
  */
-void Palette::interp(ArrayList<uint32_t> data, ArrayList<Color> &colors) {
+void Palette::interp(Span<const uint32_t> data, Span<Color> colors) {
     for (int i = 0; i < data.count(); i++) {
         interp(data[i], colors[i]);
     }
 }
 
 void Palette::interp(uint32_t data, Color &color) {
+    if (m_colors.count() == 0) {
+        // Palettes over a table have no stops, the correction is baked in
+        lookup(data, color);
+        return;
+    }
     uint32_t index = linspace_index(data, m_colors_map);
     if (index < 0) {
         color = m_colors[0];
@@ -170,20 +215,17 @@ static uint32_t linspace_index(uint32_t data,
 
 static Color color_interp(uint32_t pos, uint32_t start, uint32_t end,
                           const Color &color_start, const Color &color_end) {
-    float delta = ((float)pos - start) / ((float)end - start);
-
-    uint8_t r =
-        (uint8_t)(delta * (color_end.R() - color_start.R()) + color_start.R());
-    uint8_t g =
-        (uint8_t)(delta * (color_end.G() - color_start.G()) + color_start.G());
-    uint8_t b =
-        (uint8_t)(delta * (color_end.B() - color_start.B()) + color_start.B());
+    uint32_t offset = pos - start;
+    uint32_t span = end - start;
+
+    uint8_t r = lerp_u8(color_start.R(), color_end.R(), offset, span);
+    uint8_t g = lerp_u8(color_start.G(), color_end.G(), offset, span);
+    uint8_t b = lerp_u8(color_start.B(), color_end.B(), offset, span);
     return Color(r, g, b);
 }
 
 Palette RainbowPalette(uint32_t resolution) {
     Color colors[] = {Color::RED,  Color::YELLOW,  Color::GREEN, Color::CYAN,
                       Color::BLUE, Color::MAGENTA, Color::RED};
-    return Palette(resolution, ArrayList<Color>(colors, COUNT_OF(colors)),
-                   Color(255, 120, 120));
+    return Palette(resolution, colors, Color(palettes::RAINBOW_CORRECTION));
 }
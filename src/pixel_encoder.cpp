@@ -0,0 +1,119 @@
+#include "pixel_encoder.h"
+
+/******************************************************************************
+ * Encoders
+ ******************************************************************************/
+// Byte offsets packed in the low byte of a neoPixelType
+template <uint8_t ORDER> struct PixelLayout {
+    static const uint8_t W = (ORDER >> 6) & 0x03;
+    static const uint8_t R = (ORDER >> 4) & 0x03;
+    static const uint8_t G = (ORDER >> 2) & 0x03;
+    static const uint8_t B = ORDER & 0x03;
+    static const bool WHITE = W != R;
+    static const uint8_t SIZE = WHITE ? 4 : 3;
+};
+
+template <uint8_t ORDER>
+static inline uint8_t encode(uint8_t *pixel, uint32_t color) {
+    typedef PixelLayout<ORDER> Layout;
+    uint8_t r = (uint8_t)(color >> 16);
+    uint8_t g = (uint8_t)(color >> 8);
+    uint8_t b = (uint8_t)color;
+    uint8_t diff = (pixel[Layout::R] ^ r) | (pixel[Layout::G] ^ g) |
+                   (pixel[Layout::B] ^ b);
+    pixel[Layout::R] = r;
+    pixel[Layout::G] = g;
+    pixel[Layout::B] = b;
+    if constexpr (Layout::WHITE) {
+        uint8_t w = (uint8_t)(color >> 24);
+        diff |= pixel[Layout::W] ^ w;
+        pixel[Layout::W] = w;
+    }
+    return diff;
+}
+
+template <uint8_t ORDER>
+static uint8_t encodeSpan(uint8_t *buffer, uint16_t first,
+                          const ::Color *colors, size_t count) {
+    const uint8_t size = PixelLayout<ORDER>::SIZE;
+    const uint32_t *values = (const uint32_t *)colors;
+    uint8_t *pixel = buffer + (size_t)first * size;
+    uint8_t diff = 0;
+    for (size_t i = 0; i < count; i++) {
+        diff |= encode<ORDER>(pixel, values[i]);
+        pixel += size;
+    }
+    return diff;
+}
+
+template <uint8_t ORDER>
+static uint8_t encodeMapped(uint8_t *buffer, const uint16_t *indexes,
+                            const ::Color *colors, size_t count) {
+    const uint8_t size = PixelLayout<ORDER>::SIZE;
+    const uint32_t *values = (const uint32_t *)colors;
+    uint8_t diff = 0;
+    for (size_t i = 0; i < count; i++) {
+        diff |= encode<ORDER>(buffer + (size_t)indexes[i] * size, values[i]);
+    }
+    return diff;
+}
+
+template <uint8_t ORDER>
+static uint8_t encodeRgb(uint8_t *buffer, uint16_t first, const uint8_t *rgb,
+                         size_t count) {
+    const uint8_t size = PixelLayout<ORDER>::SIZE;
+    uint8_t *pixel = buffer + (size_t)first * size;
+    uint8_t diff = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t color = ((uint32_t)rgb[0] << 16) | ((uint32_t)rgb[1] << 8) |
+                         rgb[2];
+        diff |= encode<ORDER>(pixel, color);
+        pixel += size;
+        rgb += 3;
+    }
+    return diff;
+}
+
+#define ENCODER_CASE(order)                                                    \
+    case (order):                                                              \
+        encoder.span = encodeSpan<(order)>;                                    \
+        encoder.mapped = encodeMapped<(order)>;                                \
+        encoder.rgb = encodeRgb<(order)>;                                      \
+        break;
+
+PixelEncoder GetPixelEncoder(neoPixelType type) {
+    PixelEncoder encoder = {nullptr, nullptr, nullptr};
+    switch (type & 0xff) {
+        ENCODER_CASE(NEO_RGB)
+        ENCODER_CASE(NEO_RBG)
+        ENCODER_CASE(NEO_GRB)
+        ENCODER_CASE(NEO_GBR)
+        ENCODER_CASE(NEO_BRG)
+        ENCODER_CASE(NEO_BGR)
+        ENCODER_CASE(NEO_WRGB)
+        ENCODER_CASE(NEO_WRBG)
+        ENCODER_CASE(NEO_WGRB)
+        ENCODER_CASE(NEO_WGBR)
+        ENCODER_CASE(NEO_WBRG)
+        ENCODER_CASE(NEO_WBGR)
+        ENCODER_CASE(NEO_RWGB)
+        ENCODER_CASE(NEO_RWBG)
+        ENCODER_CASE(NEO_RGWB)
+        ENCODER_CASE(NEO_RGBW)
+        ENCODER_CASE(NEO_RBWG)
+        ENCODER_CASE(NEO_RBGW)
+        ENCODER_CASE(NEO_GWRB)
+        ENCODER_CASE(NEO_GWBR)
+        ENCODER_CASE(NEO_GRWB)
+        ENCODER_CASE(NEO_GRBW)
+        ENCODER_CASE(NEO_GBWR)
+        ENCODER_CASE(NEO_GBRW)
+        ENCODER_CASE(NEO_BWRG)
+        ENCODER_CASE(NEO_BWGR)
+        ENCODER_CASE(NEO_BRWG)
+        ENCODER_CASE(NEO_BRGW)
+        ENCODER_CASE(NEO_BGWR)
+        ENCODER_CASE(NEO_BGRW)
+    }
+    return encoder;
+}
@@ -0,0 +1,63 @@
+#include "pixel_map.h"
+
+/******************************************************************************
+ * PixelMap
+ ******************************************************************************/
+PixelMap::PixelMap(uint16_t start, uint16_t count)
+    : m_start(start), m_count(count), m_max(0), m_table(count, MEMORY_HOT) {}
+
+void PixelMap::set(uint16_t index, uint16_t physical) {
+    m_table[index] = physical;
+    if (physical > m_max) {
+        m_max = physical;
+    }
+}
+
+PixelMap PixelMap::linear(uint16_t start, uint16_t count) {
+    PixelMap map;
+    map.m_start = start;
+    map.m_count = count;
+    map.m_max = count > 0 ? start + count - 1 : start;
+    return map;
+}
+
+PixelMap PixelMap::reversed(uint16_t start, uint16_t count) {
+    PixelMap map(start, count);
+    for (uint16_t i = 0; i < count; i++) {
+        map.set(i, start + count - 1 - i);
+    }
+    return map;
+}
+
+PixelMap PixelMap::interleaved(uint16_t start, uint16_t count,
+                               uint16_t stride) {
+    if (stride <= 1) {
+        return linear(start, count);
+    }
+    PixelMap map(start, count);
+    for (uint16_t i = 0; i < count; i++) {
+        map.set(i, start + i * stride);
+    }
+    return map;
+}
+
+PixelMap PixelMap::matrix(uint16_t start, uint16_t width, uint16_t height,
+                          uint8_t layout) {
+    PixelMap map(start, width * height);
+    bool columns = layout & MATRIX_COLUMNS;
+    // Lines are the runs of pixels wired one after the other
+    uint16_t line_length = columns ? height : width;
+    for (uint16_t y = 0; y < height; y++) {
+        for (uint16_t x = 0; x < width; x++) {
+            uint16_t px = (layout & MATRIX_FLIP_X) ? width - 1 - x : x;
+            uint16_t py = (layout & MATRIX_FLIP_Y) ? height - 1 - y : y;
+            uint16_t line = columns ? px : py;
+            uint16_t pos = columns ? py : px;
+            if ((layout & MATRIX_SERPENTINE) && (line & 1)) {
+                pos = line_length - 1 - pos;
+            }
+            map.set(y * width + x, start + line * line_length + pos);
+        }
+    }
+    return map;
+}
@@ -0,0 +1,43 @@
+#include "pixel_space.h"
+
+/******************************************************************************
+ * PixelSpace
+ ******************************************************************************/
+void PixelSpace::addStrip(LedStrip *strip) {
+    addSegment(strip, 0, strip->getNumPixels());
+}
+
+void PixelSpace::addSegment(LedStrip *strip, uint16_t start, uint16_t count) {
+    Part part = {strip, start, count, m_num_pixels};
+    m_parts.add(part);
+    m_num_pixels += count;
+}
+
+void PixelSpace::writeRgb(uint32_t first, const uint8_t *rgb,
+                          uint32_t count) {
+    uint32_t end = first + count;
+    for (size_t i = 0; i < m_parts.count(); i++) {
+        const Part &part = m_parts[i];
+        uint32_t part_end = part.offset + part.count;
+        if (part_end <= first || end <= part.offset) {
+            continue;
+        }
+        uint32_t from = first > part.offset ? first : part.offset;
+        uint32_t to = end < part_end ? end : part_end;
+        part.strip->writeRgb(rgb + 3 * (from - first),
+                             part.start + (from - part.offset), to - from);
+    }
+}
+
+void PixelSpace::publish(void) {
+    // Publishing a strip twice is harmless, the second call has nothing new
+    for (size_t i = 0; i < m_parts.count(); i++) {
+        m_parts[i].strip->publish();
+    }
+}
+
+void PixelSpace::discard(void) {
+    for (size_t i = 0; i < m_parts.count(); i++) {
+        m_parts[i].strip->discard();
+    }
+}
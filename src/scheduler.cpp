@@ -0,0 +1,117 @@
+#include "scheduler.h"
+
+// Shorter waits spin instead of arming the timer
+#define SCHEDULER_SPIN_US 100
+
+int64_t FrameScheduler::s_epoch = 0;
+
+/******************************************************************************
+ * FrameScheduler
+ ******************************************************************************/
+FrameScheduler::FrameScheduler(uint32_t rate)
+    : m_rate(rate > 0 ? rate : 1), m_policy(OVERRUN_SKIP), m_phase(0),
+      m_anchor(0), m_frame(0), m_overruns(0), m_task(nullptr),
+      m_timer(nullptr) {}
+
+FrameScheduler::~FrameScheduler() {
+    if (m_timer != nullptr) {
+        esp_timer_stop(m_timer);
+        esp_timer_delete(m_timer);
+    }
+}
+
+void FrameScheduler::initEpoch(void) {
+    if (s_epoch == 0) {
+        s_epoch = esp_timer_get_time();
+    }
+}
+
+void FrameScheduler::timerCallback(void *arg) {
+    // The timer outlives tasks, wake whichever task started the scheduler last
+    TaskHandle_t task = ((FrameScheduler *)arg)->m_task;
+    if (task != nullptr) {
+        xTaskNotifyGive(task);
+    }
+}
+
+void FrameScheduler::start(void) {
+    initEpoch();
+    if (m_rate == 0) {
+        m_rate = 1;
+    }
+    m_task = xTaskGetCurrentTaskHandle();
+    if (m_timer == nullptr) {
+        esp_timer_create_args_t args = {};
+        args.callback = FrameScheduler::timerCallback;
+        args.arg = this;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name = "FrameScheduler";
+        esp_timer_create(&args, &m_timer);
+    }
+    m_anchor = s_epoch;
+    m_frame = frameAfter(esp_timer_get_time());
+    m_overruns = 0;
+}
+
+void FrameScheduler::stop(void) {
+    if (m_timer != nullptr) {
+        esp_timer_stop(m_timer);
+    }
+    m_task = nullptr;
+}
+
+uint64_t FrameScheduler::frameAfter(int64_t time_us) const {
+    int64_t elapsed = time_us - m_anchor - m_phase;
+    if (elapsed < 0) {
+        return 0;
+    }
+    // Frame k is due at k * 1e6 / m_rate, rounded down
+    uint64_t frame = ((uint64_t)elapsed * m_rate) / 1000000ULL;
+    while (deadline(frame) <= time_us) {
+        frame++;
+    }
+    return frame;
+}
+
+uint32_t FrameScheduler::wait(void) {
+    int64_t now = esp_timer_get_time();
+    uint32_t late = 0;
+    if (deadline(m_frame) < now) {
+        m_overruns++;
+        switch (m_policy) {
+        case OVERRUN_SKIP: {
+            uint64_t next = frameAfter(now);
+            late = (uint32_t)(next - m_frame);
+            m_frame = next;
+            break;
+        }
+        case OVERRUN_CATCH_UP:
+            late = (uint32_t)(frameAfter(now) - m_frame);
+            break;
+        case OVERRUN_SLIP:
+            late = 1;
+            m_anchor = now - m_phase -
+                       (int64_t)((m_frame * 1000000ULL) / m_rate);
+            break;
+        }
+    }
+    sleepUntil(deadline(m_frame));
+    m_frame++;
+    return late;
+}
+
+void FrameScheduler::sleepUntil(int64_t time_us) {
+    int64_t remaining = time_us - esp_timer_get_time();
+    while (remaining > SCHEDULER_SPIN_US && m_timer != nullptr) {
+        // Clear stale notifications and restart the timer, the wake up may
+        // also come from someone else notifying this task
+        esp_timer_stop(m_timer);
+        ulTaskNotifyTake(pdTRUE, 0);
+        esp_timer_start_once(m_timer, remaining - SCHEDULER_SPIN_US);
+        TickType_t timeout = pdMS_TO_TICKS(remaining / 1000) + 2;
+        ulTaskNotifyTake(pdTRUE, timeout);
+        remaining = time_us - esp_timer_get_time();
+    }
+    while (esp_timer_get_time() < time_us) {
+    }
+}
@@ -0,0 +1,374 @@
+#include "serial_input.h"
+#include "byte_order.h"
+#include <Arduino.h>
+
+// XOR of the header bytes between the magic and the check byte
+static uint8_t header_check(const uint8_t *data, size_t len) {
+    uint8_t check = 0x55;
+    for (size_t i = 0; i < len; i++) {
+        check ^= data[i];
+    }
+    return check;
+}
+
+static void fletcher16(uint16_t &sum1, uint16_t &sum2, const uint8_t *data,
+                       size_t len) {
+    uint32_t a = sum1;
+    uint32_t b = sum2;
+    while (len > 0) {
+        // The sums can not overflow within 4096 bytes, so they are only
+        // reduced once per block
+        size_t block = len < 4096 ? len : 4096;
+        for (size_t i = 0; i < block; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= 255;
+        b %= 255;
+        data += block;
+        len -= block;
+    }
+    sum1 = (uint16_t)a;
+    sum2 = (uint16_t)b;
+}
+
+/******************************************************************************
+ * SerialInput
+ ******************************************************************************/
+SerialInput::SerialInput(Stream *stream, BaseType_t core)
+    : ITaskManager(0, core), m_stream(stream), m_space(), m_handler(nullptr),
+      m_enabled(true), m_last_packet_ms(0), m_last_byte_ms(0),
+      m_state(STATE_MAGIC), m_magic(nullptr), m_matched(0), m_extended(false),
+      m_header_len(0), m_type(0), m_pos(0), m_end(0), m_run(0),
+      m_pixel_len(0), m_sum1(0), m_sum2(0),
+      m_received(xSemaphoreCreateBinary()), m_lock(xSemaphoreCreateMutex()) {
+    memset(&m_stats, 0, sizeof(m_stats));
+    this->m_name = "SerialInput";
+}
+
+SerialInput::~SerialInput() {
+    vSemaphoreDelete(m_received);
+    vSemaphoreDelete(m_lock);
+}
+
+void SerialInput::setEnabled(bool enable) {
+    xSemaphoreTake(m_lock, portMAX_DELAY);
+    m_enabled = enable;
+    xSemaphoreGive(m_lock);
+}
+
+bool SerialInput::isStreaming(void) const {
+    uint32_t last = m_last_packet_ms.load(std::memory_order_relaxed);
+    return last != 0 && (uint32_t)millis() - last < SERIAL_INPUT_IDLE_MS;
+}
+
+uint32_t SerialInput::poll(void) {
+    uint32_t total = 0;
+    while (true) {
+        int available = m_stream->available();
+        if (available <= 0) {
+            break;
+        }
+        size_t len = (size_t)available < sizeof(m_chunk) ? (size_t)available
+                                                         : sizeof(m_chunk);
+        len = m_stream->readBytes(m_chunk, len);
+        if (len == 0) {
+            break;
+        }
+        // m_enabled may only change between two chunks
+        xSemaphoreTake(m_lock, portMAX_DELAY);
+        feed(m_chunk, len);
+        xSemaphoreGive(m_lock);
+        total += len;
+    }
+    uint32_t now = millis();
+    if (total > 0) {
+        m_last_byte_ms = now;
+    } else if (m_state != STATE_MAGIC &&
+               now - m_last_byte_ms > SERIAL_INPUT_TIMEOUT_MS) {
+        xSemaphoreTake(m_lock, portMAX_DELAY);
+        endPacket(false);
+        xSemaphoreGive(m_lock);
+    }
+    return total;
+}
+
+void SerialInput::feed(const uint8_t *data, size_t len) {
+    m_stats.bytes += len;
+    size_t i = 0;
+    while (i < len) {
+        switch (m_state) {
+        case STATE_MAGIC: {
+            uint8_t c = data[i++];
+            if (m_matched == 0) {
+                m_extended = c == SERIAL_MAGIC[0];
+                if (c == SERIAL_ADALIGHT_MAGIC[0]) {
+                    m_magic = SERIAL_ADALIGHT_MAGIC;
+                } else if (m_extended) {
+                    m_magic = SERIAL_MAGIC;
+                } else {
+                    m_stats.ignored++;
+                    if (m_handler != nullptr) {
+                        m_handler(c);
+                    }
+                    break;
+                }
+                m_matched = 1;
+            } else if (c != (uint8_t)m_magic[m_matched]) {
+                // c may start the next magic, look at it again
+                m_stats.ignored += m_matched;
+                m_matched = 0;
+                i--;
+            } else if (++m_matched == 3) {
+                m_matched = 0;
+                m_header_len = 3;
+                m_state = STATE_HEADER;
+            }
+            break;
+        }
+        case STATE_HEADER: {
+            size_t size = m_extended ? SERIAL_HEADER_SIZE
+                                     : SERIAL_ADALIGHT_HEADER_SIZE;
+            while (i < len && m_header_len < size) {
+                m_header[m_header_len++] = data[i++];
+            }
+            if (m_header_len == size && !parseHeader()) {
+                endPacket(false);
+            }
+            break;
+        }
+        case STATE_PIXELS:
+            i += readPixels(data + i, len - i);
+            break;
+        case STATE_TOKEN:
+            addChecksum(data + i, 1);
+            readToken(data[i++]);
+            break;
+        case STATE_CHECKSUM:
+            m_header[m_header_len++] = data[i++];
+            if (m_header_len == SERIAL_CHECKSUM_SIZE) {
+                endPacket(get_be16(m_header) == ((m_sum2 << 8) | m_sum1));
+            }
+            break;
+        }
+    }
+}
+
+bool SerialInput::parseHeader(void) {
+    const uint8_t *fields = m_header + 3;
+    m_sum1 = 0;
+    m_sum2 = 0;
+    m_pixel_len = 0;
+    if (!m_extended) {
+        if (header_check(fields, 2) != fields[2]) {
+            return false;
+        }
+        m_type = SERIAL_FRAME | SERIAL_PUSH;
+        m_pos = 0;
+        m_run = get_be16(fields) + 1;
+    } else {
+        if (header_check(fields, 5) != fields[5]) {
+            return false;
+        }
+        m_type = fields[0];
+        m_pos = get_be16(fields + 1);
+        m_run = get_be16(fields + 3);
+        uint8_t kind = m_type & SERIAL_TYPE_MASK;
+        if (kind != SERIAL_FRAME && kind != SERIAL_DELTA) {
+            return false;
+        }
+        addChecksum(fields, 6);
+    }
+    m_end = m_pos + m_run;
+    if ((m_type & SERIAL_TYPE_MASK) == SERIAL_DELTA) {
+        m_run = 0;
+        m_state = STATE_TOKEN;
+    } else {
+        m_state = STATE_PIXELS;
+    }
+    if (m_pos == m_end) {
+        endPayload();
+    }
+    return true;
+}
+
+size_t SerialInput::readPixels(const uint8_t *data, size_t len) {
+    size_t used = 0;
+    if (m_pixel_len > 0) {
+        while (used < len && m_pixel_len < 3) {
+            m_pixel[m_pixel_len++] = data[used++];
+        }
+        if (m_pixel_len < 3) {
+            addChecksum(data, used);
+            return used;
+        }
+        writePixels(m_pos++, m_pixel, 1);
+        m_run--;
+        m_pixel_len = 0;
+    }
+    uint32_t count = (len - used) / 3;
+    if (count > m_run) {
+        count = m_run;
+    }
+    writePixels(m_pos, data + used, count);
+    m_pos += count;
+    m_run -= count;
+    used += 3 * count;
+    // A pixel cut by the end of the chunk is finished by the next one
+    while (m_run > 0 && used < len) {
+        m_pixel[m_pixel_len++] = data[used++];
+    }
+    addChecksum(data, used);
+    if (m_run == 0) {
+        if ((m_type & SERIAL_TYPE_MASK) == SERIAL_DELTA && m_pos < m_end) {
+            m_state = STATE_TOKEN;
+        } else {
+            endPayload();
+        }
+    }
+    return used;
+}
+
+void SerialInput::readToken(uint8_t token) {
+    uint32_t count = token < 0x80 ? token + 1 : token - 0x7f;
+    if (m_end - m_pos < count) {
+        endPacket(false);
+        return;
+    }
+    if (token >= 0x80) {
+        m_run = count;
+        m_state = STATE_PIXELS;
+        return;
+    }
+    m_pos += count;
+    if (m_pos == m_end) {
+        endPayload();
+    }
+}
+
+void SerialInput::endPayload(void) {
+    if (!m_extended) {
+        endPacket(true);
+        return;
+    }
+    m_header_len = 0;
+    m_state = STATE_CHECKSUM;
+}
+
+void SerialInput::endPacket(bool valid) {
+    m_state = STATE_MAGIC;
+    if (!valid) {
+        m_stats.errors++;
+        if (m_enabled) {
+            m_space.discard();
+        }
+        return;
+    }
+    m_stats.packets++;
+    m_last_packet_ms.store(millis() | 1, std::memory_order_relaxed);
+    if ((m_type & SERIAL_PUSH) && m_enabled) {
+        m_space.publish();
+        m_stats.frames++;
+    }
+}
+
+void SerialInput::addChecksum(const uint8_t *data, size_t len) {
+    if (m_extended) {
+        fletcher16(m_sum1, m_sum2, data, len);
+    }
+}
+
+void SerialInput::setup(void) {
+    // Adalight hosts look for this greeting to find the device
+    m_stream->write((const uint8_t *)"Ada\n", 4);
+    m_last_byte_ms = millis();
+}
+
+void SerialInput::waitForUpdate(void) {
+    // Stream reads may spin while they wait, e.g. on the USB CDC port, so
+    // the task sleeps on the semaphore instead. The timeout still drops
+    // packets cut off and notices stop().
+    if (m_stream->available() <= 0) {
+        xSemaphoreTake(m_received, pdMS_TO_TICKS(SERIAL_INPUT_TIMEOUT_MS));
+    }
+}
+
+void SerialInput::update(void) { poll(); }
+
+/******************************************************************************
+ * Packet builders
+ ******************************************************************************/
+size_t BuildAdalightHeader(uint8_t *header, uint16_t count) {
+    memcpy(header, SERIAL_ADALIGHT_MAGIC, 3);
+    put_be16(header + 3, (uint16_t)(count - 1));
+    header[5] = header_check(header + 3, 2);
+    return SERIAL_ADALIGHT_HEADER_SIZE;
+}
+
+static void put_serial_header(uint8_t *packet, uint8_t type, uint16_t first,
+                              uint16_t count) {
+    memcpy(packet, SERIAL_MAGIC, 3);
+    packet[3] = type;
+    put_be16(packet + 4, first);
+    put_be16(packet + 6, count);
+    packet[8] = header_check(packet + 3, 5);
+}
+
+// Appends the checksum of the packet written up to end
+static size_t put_serial_checksum(uint8_t *packet, uint8_t *end) {
+    uint16_t sum1 = 0;
+    uint16_t sum2 = 0;
+    fletcher16(sum1, sum2, packet + 3, end - packet - 3);
+    put_be16(end, (uint16_t)((sum2 << 8) | sum1));
+    return end - packet + SERIAL_CHECKSUM_SIZE;
+}
+
+size_t BuildSerialFrame(uint8_t *packet, size_t size, uint16_t first,
+                        const uint8_t *rgb, uint16_t count, bool push) {
+    size_t length = 3 * (size_t)count;
+    if (size < SERIAL_HEADER_SIZE + length + SERIAL_CHECKSUM_SIZE) {
+        return 0;
+    }
+    put_serial_header(packet, SERIAL_FRAME | (push ? SERIAL_PUSH : 0), first,
+                      count);
+    memcpy(packet + SERIAL_HEADER_SIZE, rgb, length);
+    return put_serial_checksum(packet, packet + SERIAL_HEADER_SIZE + length);
+}
+
+size_t BuildSerialDelta(uint8_t *packet, size_t size, uint16_t first,
+                        const uint8_t *rgb, const uint8_t *previous,
+                        uint16_t count, bool push) {
+    if (size < SERIAL_HEADER_SIZE + 3 * (size_t)count + count / 128 + 3) {
+        return 0;
+    }
+    auto same = [&](uint32_t i) {
+        return memcmp(rgb + 3 * i, previous + 3 * i, 3) == 0;
+    };
+    // Unchanged pixels at the end need no token
+    while (count > 0 && same(count - 1)) {
+        count--;
+    }
+    put_serial_header(packet, SERIAL_DELTA | (push ? SERIAL_PUSH : 0), first,
+                      count);
+    uint8_t *out = packet + SERIAL_HEADER_SIZE;
+    uint32_t i = 0;
+    while (i < count) {
+        uint32_t run = 0;
+        while (i + run < count && run < 128 && same(i + run)) {
+            run++;
+        }
+        if (run > 0) {
+            *out++ = (uint8_t)(run - 1);
+            i += run;
+            continue;
+        }
+        while (i + run < count && run < 128 && !same(i + run)) {
+            run++;
+        }
+        *out++ = (uint8_t)(0x7f + run);
+        memcpy(out, rgb + 3 * i, 3 * run);
+        out += 3 * run;
+        i += run;
+    }
+    return put_serial_checksum(packet, out);
+}
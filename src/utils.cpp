@@ -36,12 +36,19 @@ void hex_dump(const void *data, size_t size) {
  ******************************************************************************/
 ITaskManager::ITaskManager(uint32_t refresh_rate, BaseType_t core)
     : m_refresh_rate(refresh_rate), m_core(core), m_task_handler(nullptr),
-      m_stop(false) {}
+      m_stop(false), m_scheduler(refresh_rate), m_name("ITaskManager"),
+      m_priority(tskIDLE_PRIORITY + 1), m_stack_size(10000) {
+    resetStats();
+}
 
 void ITaskManager::start(void) {
     this->m_stop = false;
-    xTaskCreatePinnedToCore(ITaskManager::ITaskManagerTask, "ITaskManager",
-                            10000, this, tskIDLE_PRIORITY + 1,
+    // All tasks count their frames from the same epoch
+    FrameScheduler::initEpoch();
+    this->m_scheduler.setRate(this->m_refresh_rate);
+    this->resetStats();
+    xTaskCreatePinnedToCore(ITaskManager::ITaskManagerTask, this->m_name,
+                            this->m_stack_size, this, this->m_priority,
                             &(this->m_task_handler), this->m_core);
 }
 
@@ -51,19 +58,83 @@ void ITaskManager::ITaskManagerTask(void *ctx) {
     ITaskManager *manager = (ITaskManager *)ctx;
     manager->setup();
 
-    uint32_t sleep_time_ticks =
-        pdMS_TO_TICKS((uint32_t)(1000 / manager->m_refresh_rate));
-
+    manager->m_scheduler.start();
     while (manager->m_stop == false) {
-        uint32_t start = xTaskGetTickCount();
+        manager->waitForUpdate();
+        int64_t start = esp_timer_get_time();
         manager->update();
-        uint32_t end = xTaskGetTickCount();
-        uint32_t delta = (end - start);
-        if (delta < sleep_time_ticks) {
-            uint32_t sleep_ticks = sleep_time_ticks - delta;
-            vTaskDelay(sleep_ticks);
-        }
+        manager->recordUpdate((uint32_t)(esp_timer_get_time() - start));
     }
 
+    manager->m_scheduler.stop();
     manager->cleanup();
+    manager->m_task_handler = nullptr;
+    // FreeRTOS tasks must not return
+    vTaskDelete(nullptr);
+}
+
+void ITaskManager::recordUpdate(uint32_t duration_us) {
+    TaskStats &stats = this->m_stats;
+    stats.frames++;
+    stats.busy_us += duration_us;
+    if (duration_us < stats.min_us) {
+        stats.min_us = duration_us;
+    }
+    if (duration_us > stats.max_us) {
+        stats.max_us = duration_us;
+    }
+    if (this->m_refresh_rate > 0 &&
+        duration_us > 1000000 / this->m_refresh_rate) {
+        stats.over_budget++;
+    }
+    uint32_t bucket = 0;
+    uint32_t limit = TASK_STATS_FIRST_BUCKET_US;
+    while (bucket < TASK_STATS_BUCKETS - 1 && duration_us >= limit) {
+        bucket++;
+        limit <<= 1;
+    }
+    stats.histogram[bucket]++;
+    if (this->m_task_handler != nullptr &&
+        (stats.frames - 1) % TASK_STATS_STACK_EVERY == 0) {
+        uint32_t stack_free = uxTaskGetStackHighWaterMark(this->m_task_handler);
+        if (stack_free < stats.stack_free) {
+            stats.stack_free = stack_free;
+        }
+    }
+}
+
+void ITaskManager::resetStats(void) {
+    memset(&this->m_stats, 0, sizeof(this->m_stats));
+    this->m_stats.min_us = UINT32_MAX;
+    this->m_stats.stack_free = UINT32_MAX;
+    this->m_stats_start = esp_timer_get_time();
+}
+
+void ITaskManager::getStats(TaskStats &stats) {
+    stats = this->m_stats;
+    stats.overruns = this->m_scheduler.getOverruns();
+    stats.elapsed_us = esp_timer_get_time() - this->m_stats_start;
+    stats.cpu_permille =
+        stats.elapsed_us > 0 ? (stats.busy_us * 1000) / stats.elapsed_us : 0;
+    if (stats.frames == 0) {
+        stats.min_us = 0;
+    }
+}
+
+void ITaskManager::dumpStats(void) {
+    TaskStats stats;
+    getStats(stats);
+    uint32_t avg = stats.frames > 0 ? stats.busy_us / stats.frames : 0;
+    Serial.printf("%s: frames %u overruns %u over_budget %u us %u/%u/%u "
+                  "cpu %u.%u%% stack_free %u hist",
+                  this->m_name, (unsigned)stats.frames,
+                  (unsigned)stats.overruns, (unsigned)stats.over_budget,
+                  (unsigned)stats.min_us, (unsigned)avg,
+                  (unsigned)stats.max_us, (unsigned)stats.cpu_permille / 10,
+                  (unsigned)stats.cpu_permille % 10,
+                  (unsigned)stats.stack_free);
+    for (uint32_t i = 0; i < TASK_STATS_BUCKETS; i++) {
+        Serial.printf(" %u", (unsigned)stats.histogram[i]);
+    }
+    Serial.printf("\n");
 }
@@ -0,0 +1,222 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "effects.h"
+#include "frame_recording.h"
+#include "palettes.h"
+
+/******************************************************************************
+ * Host tool converting between effects, raw frames and recordings
+ ******************************************************************************/
+static void usage(void) {
+    printf("usage:\n"
+           "  recorder record <sparks|roll|pulses> <pixels> <frames> <rate> "
+           "<out> [keyframe interval]\n"
+           "  recorder import <raw rgb in> <pixels> <rate> <out> "
+           "[keyframe interval]\n"
+           "  recorder export <in> <raw rgb out>\n"
+           "  recorder info <in>\n");
+}
+
+// Same settings as the effects of the firmware
+static EffectBase *create_effect(const char *name, ILedStrip *strip) {
+    if (strcmp(name, "sparks") == 0) {
+        Sparks<uint8_t> *effect = new Sparks<uint8_t>(strip, palettes::WHITE);
+        effect->setMinHeat(20);
+        effect->setMaxHeat(255);
+        effect->setColdDown(-2.5f);
+        effect->setNumOfSparks(0.75f);
+        effect->setSparkValue(255);
+        return effect;
+    }
+    if (strcmp(name, "roll") == 0) {
+        Roll<uint8_t> *effect = new Roll<uint8_t>(strip, palettes::RAINBOW_8);
+        effect->setMinHeat(0);
+        effect->setMaxHeat(8);
+        effect->setSpeed(0.1f);
+        effect->setRollSpeed(0.1f);
+        return effect;
+    }
+    if (strcmp(name, "pulses") == 0) {
+        Pulses<uint8_t> *effect =
+            new Pulses<uint8_t>(strip, palettes::RAINBOW);
+        effect->setMinHeat(0);
+        effect->setMaxHeat(255);
+        effect->setSpeed(1);
+        return effect;
+    }
+    return nullptr;
+}
+
+static FrameRecorder *create_recorder(const char *path, uint16_t pixels,
+                                      uint16_t rate, uint16_t keyframes) {
+    FILE *file = fopen(path, "wb");
+    if (file == nullptr) {
+        printf("can not create %s\n", path);
+        return nullptr;
+    }
+    return new FrameRecorder(new FileFrameSink(file), pixels, rate, keyframes);
+}
+
+static void report_recorder(const FrameRecorder &recorder, uint16_t pixels) {
+    const FrameEncoder &encoder = recorder.getEncoder();
+    uint64_t raw = (uint64_t)encoder.getFrameCount() * pixels * 3;
+    printf("%u frames, %u bytes, %.1f%% of raw rgb\n",
+           (unsigned)encoder.getFrameCount(), (unsigned)encoder.getSize(),
+           raw ? 100.0 * encoder.getSize() / raw : 0.0);
+}
+
+static int record(int argc, char **argv) {
+    if (argc < 7) {
+        usage();
+        return 1;
+    }
+    uint16_t pixels = (uint16_t)atoi(argv[3]);
+    uint32_t frames = (uint32_t)atoi(argv[4]);
+    uint16_t rate = (uint16_t)atoi(argv[5]);
+    uint16_t keyframes = argc > 7 ? (uint16_t)atoi(argv[7]) : rate;
+    if (rate == 0) {
+        usage();
+        return 1;
+    }
+    FrameRecorder *recorder = create_recorder(argv[6], pixels, rate,
+                                              keyframes);
+    if (recorder == nullptr) {
+        return 1;
+    }
+    EffectBase *effect = create_effect(argv[2], recorder);
+    if (effect == nullptr) {
+        printf("unknown effect %s\n", argv[2]);
+        delete recorder;
+        return 1;
+    }
+    for (uint32_t i = 0; i < frames; i++) {
+        effect->update(1000000 / rate);
+        if (!recorder->recordFrame()) {
+            printf("write failed\n");
+            break;
+        }
+    }
+    report_recorder(*recorder, pixels);
+    delete effect;
+    delete recorder;
+    return 0;
+}
+
+static int import(int argc, char **argv) {
+    if (argc < 6) {
+        usage();
+        return 1;
+    }
+    FILE *in = fopen(argv[2], "rb");
+    if (in == nullptr) {
+        printf("can not open %s\n", argv[2]);
+        return 1;
+    }
+    uint16_t pixels = (uint16_t)atoi(argv[3]);
+    uint16_t rate = (uint16_t)atoi(argv[4]);
+    uint16_t keyframes = argc > 6 ? (uint16_t)atoi(argv[6]) : rate;
+    FrameRecorder *recorder = create_recorder(argv[5], pixels, rate,
+                                              keyframes);
+    if (recorder == nullptr) {
+        fclose(in);
+        return 1;
+    }
+    ArrayList<uint8_t> rgb(3 * pixels);
+    while (fread(rgb.data(), 3, pixels, in) == pixels) {
+        for (uint16_t i = 0; i < pixels; i++) {
+            const uint8_t *p = rgb.data() + 3 * i;
+            recorder->updatePixel(i, Color(p[0], p[1], p[2]));
+        }
+        recorder->recordFrame();
+    }
+    report_recorder(*recorder, pixels);
+    fclose(in);
+    delete recorder;
+    return 0;
+}
+
+// Maps path in memory and plays it with op called on every frame
+template <typename Op> static int play(const char *path, Op op) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        printf("can not open %s\n", path);
+        return 1;
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("can not map %s\n", path);
+        return 1;
+    }
+    MemoryFrameSource source((const uint8_t *)data, st.st_size);
+    FrameDecoder decoder(&source);
+    int result = 1;
+    if (!decoder.begin()) {
+        printf("%s is not a recording\n", path);
+    } else {
+        uint32_t frames = 0;
+        while (decoder.nextFrame()) {
+            op(decoder.getFrame());
+            frames++;
+        }
+        const RecordingInfo &info = decoder.getInfo();
+        printf("%u pixels, %u fps, keyframe every %u frames\n",
+               (unsigned)info.num_pixels, (unsigned)info.frame_rate,
+               (unsigned)info.keyframe_interval);
+        printf("%u frames, %u bytes, %.1f%% of raw rgb\n", (unsigned)frames,
+               (unsigned)st.st_size,
+               frames ? 100.0 * st.st_size / (3.0 * frames * info.num_pixels)
+                      : 0.0);
+        result = 0;
+    }
+    munmap(data, st.st_size);
+    return result;
+}
+
+static int export_raw(int argc, char **argv) {
+    if (argc < 4) {
+        usage();
+        return 1;
+    }
+    FILE *out = fopen(argv[3], "wb");
+    if (out == nullptr) {
+        printf("can not create %s\n", argv[3]);
+        return 1;
+    }
+    int result = play(argv[2], [&](LedsSpan frame) {
+        for (size_t i = 0; i < frame.count(); i++) {
+            uint8_t rgb[] = {frame[i].R(), frame[i].G(), frame[i].B()};
+            fwrite(rgb, 1, sizeof(rgb), out);
+        }
+    });
+    fclose(out);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+    if (strcmp(argv[1], "record") == 0) {
+        return record(argc, argv);
+    }
+    if (strcmp(argv[1], "import") == 0) {
+        return import(argc, argv);
+    }
+    if (strcmp(argv[1], "export") == 0) {
+        return export_raw(argc, argv);
+    }
+    if (strcmp(argv[1], "info") == 0) {
+        return play(argv[2], [](LedsSpan) {});
+    }
+    usage();
+    return 1;
+}
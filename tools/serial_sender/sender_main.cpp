@@ -0,0 +1,163 @@
+#include <chrono>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+
+#include "fd_stream.h"
+#include "serial_input.h"
+
+/******************************************************************************
+ * Host tool streaming a test pattern over a serial port, and receiving it on
+ * a pty to test senders without a board
+ ******************************************************************************/
+static void usage(void) {
+    printf("usage:\n"
+           "  serial_sender send <ada|frame|delta> <device> <pixels> <fps> "
+           "<frames>\n"
+           "  serial_sender receive <pixels> [seconds]\n");
+}
+
+// Comets of 8 pixels every 50 pixels moving one pixel per frame, most
+// pixels stay black so delta frames are small
+static void pattern(uint8_t *rgb, uint32_t pixels, uint32_t frame) {
+    memset(rgb, 0, 3 * pixels);
+    for (uint32_t i = 0; i < pixels; i++) {
+        uint32_t tail = (frame + 50 - i % 50) % 50;
+        if (tail < 8) {
+            uint8_t value = (uint8_t)(255 >> tail);
+            rgb[3 * i] = value;
+            rgb[3 * i + 1] = (uint8_t)(value / 2);
+            rgb[3 * i + 2] = (uint8_t)(i * 5);
+        }
+    }
+}
+
+static int send(int argc, char **argv) {
+    if (argc < 7) {
+        usage();
+        return 1;
+    }
+    const char *mode = argv[2];
+    uint32_t pixels = (uint32_t)atoi(argv[4]);
+    uint32_t fps = (uint32_t)atoi(argv[5]);
+    uint32_t frames = (uint32_t)atoi(argv[6]);
+    bool ada = strcmp(mode, "ada") == 0;
+    bool delta = strcmp(mode, "delta") == 0;
+    if ((!ada && !delta && strcmp(mode, "frame") != 0) || pixels == 0 ||
+        pixels > 65535 || fps == 0) {
+        usage();
+        return 1;
+    }
+    int fd = open(argv[3], O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        printf("can not open %s\n", argv[3]);
+        return 1;
+    }
+    SetRawMode(fd);
+
+    uint8_t *rgb = (uint8_t *)malloc(3 * pixels);
+    uint8_t *previous = (uint8_t *)calloc(3, pixels);
+    size_t size = SERIAL_HEADER_SIZE + 4 * pixels;
+    uint8_t *packet = (uint8_t *)malloc(size);
+    uint64_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        pattern(rgb, pixels, frame);
+        size_t len;
+        if (ada) {
+            len = BuildAdalightHeader(packet, pixels);
+            memcpy(packet + len, rgb, 3 * pixels);
+            len += 3 * pixels;
+        } else if (delta && frame % fps != 0) {
+            len = BuildSerialDelta(packet, size, 0, rgb, previous, pixels,
+                                   true);
+        } else {
+            // A whole frame every second lets a receiver that lost a
+            // packet catch up
+            len = BuildSerialFrame(packet, size, 0, rgb, pixels, true);
+        }
+        if (write(fd, packet, len) != (ssize_t)len) {
+            printf("write failed\n");
+            break;
+        }
+        bytes += len;
+        memcpy(previous, rgb, 3 * pixels);
+        std::this_thread::sleep_until(
+            start + std::chrono::microseconds((frame + 1) * 1000000ULL / fps));
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    printf("%u frames, %llu bytes in %.2f s, %.1f fps, %.0f bytes/s\n",
+           (unsigned)frames, (unsigned long long)bytes, seconds,
+           frames / seconds, bytes / seconds);
+    free(packet);
+    free(previous);
+    free(rgb);
+    close(fd);
+    return 0;
+}
+
+static int receive(int argc, char **argv) {
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+    uint16_t pixels = (uint16_t)atoi(argv[2]);
+    uint32_t seconds = argc > 3 ? (uint32_t)atoi(argv[3]) : 30;
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        printf("can not open a pty\n");
+        return 1;
+    }
+    // The pty stays open on this side, senders open the slave
+    SetRawMode(master);
+    printf("send to %s\n", ptsname(master));
+    fflush(stdout);
+
+    FdStream stream(master);
+    LedStrip strip(pixels, 0, NEO_GRB + NEO_KHZ800);
+    SerialInput input(&stream);
+    input.addStrip(&strip);
+    uint32_t drawn = 0;
+    for (uint32_t second = 0; second < seconds; second++) {
+        const SerialInputStats &stats = input.getStats();
+        uint32_t frames = stats.frames;
+        uint32_t bytes = stats.bytes;
+        for (int i = 0; i < 1000; i++) {
+            input.poll();
+            if (strip.hasNewFrame()) {
+                strip.draw();
+                drawn++;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        printf("%u fps, %u bytes/s, %u frames, %u drawn, %u errors, "
+               "%u ignored bytes\n",
+               (unsigned)(stats.frames - frames),
+               (unsigned)(stats.bytes - bytes), (unsigned)stats.frames,
+               (unsigned)drawn, (unsigned)stats.errors,
+               (unsigned)stats.ignored);
+        fflush(stdout);
+    }
+    close(master);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+    if (strcmp(argv[1], "send") == 0) {
+        return send(argc, argv);
+    }
+    if (strcmp(argv[1], "receive") == 0) {
+        return receive(argc, argv);
+    }
+    usage();
+    return 1;
+}
@@ -0,0 +1,110 @@
+#include <arpa/inet.h>
+#include <chrono>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#include "network_input.h"
+
+/******************************************************************************
+ * Host tool streaming a test pattern to a NetworkInput
+ ******************************************************************************/
+static void usage(void) {
+    printf("usage: sender <ddp|e131|e131-sync> <host> <pixels> <fps> "
+           "<frames> [port]\n");
+}
+
+// Rainbow moving one pixel per frame
+static void pattern(uint8_t *rgb, uint32_t pixels, uint32_t frame) {
+    for (uint32_t i = 0; i < pixels; i++) {
+        uint8_t pos = (uint8_t)((i + frame) * 256 / 60);
+        uint8_t *p = rgb + 3 * i;
+        if (pos < 85) {
+            p[0] = 255 - pos * 3, p[1] = pos * 3, p[2] = 0;
+        } else if (pos < 170) {
+            pos -= 85;
+            p[0] = 0, p[1] = 255 - pos * 3, p[2] = pos * 3;
+        } else {
+            pos -= 170;
+            p[0] = pos * 3, p[1] = 0, p[2] = 255 - pos * 3;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 6) {
+        usage();
+        return 1;
+    }
+    bool ddp = strcmp(argv[1], "ddp") == 0;
+    bool sync = strcmp(argv[1], "e131-sync") == 0;
+    if (!ddp && !sync && strcmp(argv[1], "e131") != 0) {
+        usage();
+        return 1;
+    }
+    uint32_t pixels = (uint32_t)atoi(argv[3]);
+    uint32_t fps = (uint32_t)atoi(argv[4]);
+    uint32_t frames = (uint32_t)atoi(argv[5]);
+    uint16_t port = argc > 6 ? (uint16_t)atoi(argv[6])
+                             : (ddp ? DDP_PORT : E131_PORT);
+    if (pixels == 0 || fps == 0) {
+        usage();
+        return 1;
+    }
+
+    struct addrinfo hints;
+    struct addrinfo *target;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    char service[8];
+    snprintf(service, sizeof(service), "%u", (unsigned)port);
+    if (getaddrinfo(argv[2], service, &hints, &target) != 0) {
+        printf("can not resolve %s\n", argv[2]);
+        return 1;
+    }
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+    uint8_t *rgb = (uint8_t *)malloc(3 * pixels);
+    uint8_t packet[NETWORK_INPUT_PACKET_SIZE];
+    uint32_t per_packet = ddp ? 480 : E131_PIXELS_PER_UNIVERSE;
+    uint64_t packets = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        pattern(rgb, pixels, frame);
+        for (uint32_t first = 0; first < pixels; first += per_packet) {
+            uint16_t count = pixels - first < per_packet ? pixels - first
+                                                         : per_packet;
+            const uint8_t *data = rgb + 3 * first;
+            size_t size =
+                ddp ? BuildDdpPacket(packet, sizeof(packet), frame % 15 + 1,
+                                     first, data, count,
+                                     first + count == pixels)
+                    : BuildE131Packet(packet, sizeof(packet), frame,
+                                      1 + first / per_packet, sync ? 1 : 0,
+                                      data, count);
+            sendto(fd, packet, size, 0, target->ai_addr, target->ai_addrlen);
+            packets++;
+        }
+        if (sync) {
+            size_t size = BuildE131Sync(packet, sizeof(packet), frame, 1);
+            sendto(fd, packet, size, 0, target->ai_addr, target->ai_addrlen);
+            packets++;
+        }
+        std::this_thread::sleep_until(
+            start + std::chrono::microseconds((frame + 1) * 1000000ULL / fps));
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    printf("%u frames, %llu packets in %.2f s, %.1f fps\n", (unsigned)frames,
+           (unsigned long long)packets, seconds, frames / seconds);
+    free(rgb);
+    freeaddrinfo(target);
+    close(fd);
+    return 0;
+}